@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""Measure how StarSpace scales with threads, dim, vocabulary and trainMode.
+
+Synthetic corpora are written by gen_corpus (make gen_corpus), then every
+combination of the swept values is trained and evaluated with starspace,
+and one CSV row is printed per run: load time, training examples/sec, peak
+resident memory and evaluation queries/sec. Nothing is downloaded.
+
+Example, from the root of the repository:
+
+    make opt gen_corpus
+    python3 examples/scaling_benchmark.py --threads 1,2,4,8 --dims 50,100 \
+        --output scaling.csv
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+
+FIELDS = [
+    "format", "train_mode", "vocab", "labels", "examples", "dim", "thread",
+    "load_sec", "train_sec", "train_examples_per_sec", "train_peak_rss_mb",
+    "eval_examples", "eval_sec", "eval_qps", "eval_peak_rss_mb", "hit_at_1",
+]
+
+
+def int_list(value):
+    return [int(v) for v in value.split(",") if v]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--starspace", default="./starspace",
+                        help="starspace binary [%(default)s]")
+    parser.add_argument("--gen-corpus", default="./gen_corpus",
+                        help="gen_corpus binary [%(default)s]")
+    parser.add_argument("--workdir", default="/tmp/starspace_scaling",
+                        help="where corpora, models and logs go [%(default)s]")
+    parser.add_argument("--output", default="-",
+                        help="CSV file, or - for stdout [%(default)s]")
+    parser.add_argument("--format", default="fastText",
+                        choices=["fastText", "labelDoc"])
+    parser.add_argument("--train-modes", type=int_list, default=None,
+                        help="trainMode values; 0 for fastText and 3 for "
+                             "labelDoc by default")
+    parser.add_argument("--threads", type=int_list, default=[1, 2, 4],
+                        help="-thread values [1,2,4]")
+    parser.add_argument("--dims", type=int_list, default=[50, 100],
+                        help="-dim values [50,100]")
+    parser.add_argument("--vocabs", type=int_list, default=[50000],
+                        help="vocabulary sizes of the corpora [50000]")
+    parser.add_argument("--examples", type=int, default=100000,
+                        help="training lines [%(default)s]")
+    parser.add_argument("--test-examples", type=int, default=10000,
+                        help="evaluation lines [%(default)s]")
+    parser.add_argument("--labels", type=int, default=100,
+                        help="labels (fastText) or topics (labelDoc) "
+                             "[%(default)s]")
+    parser.add_argument("--length", type=int, default=20,
+                        help="mean words per document [%(default)s]")
+    parser.add_argument("--zipf", type=float, default=1.0,
+                        help="Zipf exponent of the words [%(default)s]")
+    parser.add_argument("--epoch", type=int, default=1,
+                        help="training epochs [%(default)s]")
+    parser.add_argument("--max-basedocs", type=int, default=10000,
+                        help="labelDoc only: candidate documents evaluation "
+                             "ranks [%(default)s]")
+    parser.add_argument("--train-args", default="",
+                        help="extra arguments of starspace train")
+    args = parser.parse_args()
+    if args.train_modes is None:
+        args.train_modes = [0] if args.format == "fastText" else [3]
+    return args
+
+
+def run(cmd, log_path, markers):
+    """Run cmd, logging its output. Returns, for each marker regexp that
+    matched a line of its stdout, the time after start of the last match
+    and the match, and the peak resident memory of cmd in MB."""
+    seen = {}
+    start = time.time()
+    with open(log_path, "w") as log:
+        proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                                stderr=log, universal_newlines=True)
+        for line in proc.stdout:
+            now = time.time() - start
+            log.write(line)
+            for name, regexp in markers.items():
+                m = re.search(regexp, line)
+                if m:
+                    seen[name] = (now, m)
+        # wait4 gives the resources of this child only, unlike
+        # getrusage(RUSAGE_CHILDREN), which keeps the largest one so far.
+        proc.stdout.close()
+        _, status, usage = os.wait4(proc.pid, 0)
+        proc.returncode = os.WEXITSTATUS(status) \
+            if os.WIFEXITED(status) else -1
+    if proc.returncode != 0:
+        sys.exit("%s failed, see %s" % (cmd[0], log_path))
+    # ru_maxrss is in kilobytes on Linux.
+    return seen, usage.ru_maxrss / 1024.0
+
+
+def generate(args, vocab):
+    """Write the training and test corpora of a vocabulary size. Corpora
+    are reused only if every parameter of gen_corpus matches, as they are
+    all part of the file name."""
+    paths = {}
+    for name, examples, seed in [("train", args.examples, 1),
+                                 ("test", args.test_examples, 2)]:
+        path = os.path.join(args.workdir, "%s_v%d_n%d_l%d_len%d_z%g_s%d.%s" % (
+            args.format, vocab, examples, args.labels, args.length,
+            args.zipf, seed, name))
+        if not os.path.exists(path):
+            subprocess.check_call([
+                args.gen_corpus, "-output", path, "-format", args.format,
+                "-examples", str(examples), "-vocab", str(vocab),
+                "-labels", str(args.labels), "-length", str(args.length),
+                "-zipf", str(args.zipf), "-seed", str(seed)])
+        paths[name] = path
+    if args.format == "labelDoc":
+        # Evaluation ranks the documents of the test lines.
+        basedoc = paths["test"] + ".basedoc"
+        docs = []
+        with open(paths["test"]) as f:
+            for line in f:
+                for doc in line.rstrip("\n").split("\t"):
+                    if len(docs) < args.max_basedocs:
+                        docs.append(doc)
+        with open(basedoc, "w") as f:
+            f.write("\n".join(docs) + "\n")
+        paths["basedoc"] = basedoc
+    return paths
+
+
+def examples_per_sec(metrics_path):
+    """Training throughput over all the epochs of a -metricsFile."""
+    examples, seconds = 0, 0.0
+    with open(metrics_path) as f:
+        for line in f:
+            record = json.loads(line)
+            if record["event"] == "epoch" and record["examples_per_sec"] > 0:
+                examples += record["examples"]
+                seconds += record["examples"] / record["examples_per_sec"]
+    return (examples / seconds if seconds > 0 else 0.0), seconds
+
+
+def benchmark(args, vocab, paths, train_mode, dim, thread):
+    name = "%s_v%d_m%d_d%d_t%d" % (args.format, vocab, train_mode, dim, thread)
+    model = os.path.join(args.workdir, name)
+    metrics = model + ".metrics"
+    train_cmd = [
+        args.starspace, "train", "-trainFile", paths["train"],
+        "-model", model, "-fileFormat", args.format,
+        "-trainMode", str(train_mode), "-dim", str(dim),
+        "-thread", str(thread), "-epoch", str(args.epoch),
+        "-metricsFile", metrics] + args.train_args.split()
+    # Training starts once the data is loaded.
+    seen, train_rss = run(train_cmd, model + ".train.log",
+                          {"training": r"^Training epoch 0"})
+    load_sec = seen["training"][0] if "training" in seen else float("nan")
+    throughput, train_sec = examples_per_sec(metrics)
+
+    test_cmd = [args.starspace, "test", "-testFile", paths["test"],
+                "-model", model, "-thread", str(thread)]
+    if "basedoc" in paths:
+        test_cmd += ["-basedoc", paths["basedoc"]]
+    # Evaluation starts once the base docs are projected, which is done
+    # again after the model args are printed.
+    seen, eval_rss = run(test_cmd, model + ".test.log", {
+        "loaded": r"^(Predictions use|Finished loading)",
+        "done": r"hit@1: ([0-9.e-]+).*Total examples : ([0-9]+)",
+    })
+    if "loaded" not in seen or "done" not in seen:
+        sys.exit("Unexpected output of starspace test, see %s.test.log" % model)
+    eval_sec = seen["done"][0] - seen["loaded"][0]
+    eval_examples = int(seen["done"][1].group(2))
+    return {
+        "format": args.format, "train_mode": train_mode, "vocab": vocab,
+        "labels": args.labels, "examples": args.examples, "dim": dim,
+        "thread": thread,
+        "load_sec": "%.3f" % load_sec,
+        "train_sec": "%.3f" % train_sec,
+        "train_examples_per_sec": "%.1f" % throughput,
+        "train_peak_rss_mb": "%.1f" % train_rss,
+        "eval_examples": eval_examples,
+        "eval_sec": "%.3f" % eval_sec,
+        "eval_qps": "%.1f" % (eval_examples / eval_sec if eval_sec > 0 else 0),
+        "eval_peak_rss_mb": "%.1f" % eval_rss,
+        "hit_at_1": seen["done"][1].group(1),
+    }
+
+
+def main():
+    args = parse_args()
+    for binary in [args.starspace, args.gen_corpus]:
+        if not os.access(binary, os.X_OK):
+            sys.exit("%s not found; build it with make" % binary)
+    os.makedirs(args.workdir, exist_ok=True)
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    writer = csv.DictWriter(out, fieldnames=FIELDS)
+    writer.writeheader()
+    for vocab in args.vocabs:
+        paths = generate(args, vocab)
+        for train_mode in args.train_modes:
+            for dim in args.dims:
+                for thread in args.threads:
+                    writer.writerow(benchmark(
+                        args, vocab, paths, train_mode, dim, thread))
+                    out.flush()
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -30,6 +30,8 @@ PYBIND11_MODULE(starwrap, m) {
 		.def_readwrite("dropoutLHS", &starspace::Args::dropoutLHS)
 		.def_readwrite("dropoutRHS", &starspace::Args::dropoutRHS)
 		.def_readwrite("wordWeight", &starspace::Args::wordWeight)
+		.def_readwrite("wordNegPower", &starspace::Args::wordNegPower)
+		.def_readwrite("labelNegPower", &starspace::Args::labelNegPower)
 		.def_readwrite("dim", &starspace::Args::dim)
 		.def_readwrite("epoch", &starspace::Args::epoch)
 		.def_readwrite("ws", &starspace::Args::ws)
@@ -56,6 +58,20 @@ PYBIND11_MODULE(starwrap, m) {
 		.def_readwrite("useWeight", &starspace::Args::useWeight)
 		.def_readwrite("trainWord", &starspace::Args::trainWord)
 		.def_readwrite("excludeLHS", &starspace::Args::excludeLHS)
+		.def_readwrite("queryCacheSize", &starspace::Args::queryCacheSize)
+		.def_readwrite("cutoff", &starspace::Args::cutoff)
+		.def_readwrite("saveInterval", &starspace::Args::saveInterval)
+		.def_readwrite("keepCheckpoints", &starspace::Args::keepCheckpoints)
+		.def_readwrite("singlePass", &starspace::Args::singlePass)
+		.def_readwrite("dictBudget", &starspace::Args::dictBudget)
+		.def_readwrite("hardNegatives", &starspace::Args::hardNegatives)
+		.def_readwrite("hardNegRefresh", &starspace::Args::hardNegRefresh)
+		.def_readwrite("inBatchNeg", &starspace::Args::inBatchNeg)
+		.def_readwrite("metricsFile", &starspace::Args::metricsFile)
+		.def_readwrite("reportInterval", &starspace::Args::reportInterval)
+		.def_readwrite("mmapModel", &starspace::Args::mmapModel)
+		.def_readwrite("mmapWriteBack", &starspace::Args::mmapWriteBack)
+		.def_readwrite("pinRows", &starspace::Args::pinRows)
 		;
 
 	py::class_<starspace::Matrix <starspace::Real>>(m, "Matrix", py::buffer_protocol())
@@ -79,7 +95,9 @@ PYBIND11_MODULE(starwrap, m) {
 		.def("initFromSavedModel", &starspace::StarSpace::initFromSavedModel)
 
 		.def("train", &starspace::StarSpace::train)
-		.def("evaluate", &starspace::StarSpace::evaluate)
+		.def("evaluate", [](starspace::StarSpace& sp) { sp.evaluate(); })
+		.def("prune", &starspace::StarSpace::prune)
+		.def("quantize", &starspace::StarSpace::quantize)
 
 		.def("getDocVector", &starspace::StarSpace::getDocVector)
 
@@ -89,5 +107,9 @@ PYBIND11_MODULE(starwrap, m) {
 		.def("saveModel", &starspace::StarSpace::saveModel)
 		.def("saveModelTsv", &starspace::StarSpace::saveModelTsv)
 		.def("loadBaseDocs", &starspace::StarSpace::loadBaseDocs)
+
+		.def("queryCacheHits", &starspace::StarSpace::queryCacheHits)
+		.def("queryCacheMisses", &starspace::StarSpace::queryCacheMisses)
+		.def("clearQueryCache", &starspace::StarSpace::clearQueryCache)
 		;
 }
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Writes a synthetic corpus in the fastText or labelDoc format, to measure
+// how training scales without downloading a dataset. Words follow a Zipf
+// distribution, and each line has a topic (its label in fastText) which a
+// fraction of its words are drawn from, so that models can learn it.
+
+#include "../utils/alias_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+struct Options {
+  string output;
+  string format = "fastText";
+  long examples = 100000;
+  int vocab = 50000;
+  double zipf = 1.0;
+  int labels = 100;
+  double labelZipf = 1.0;
+  int length = 20;
+  int sentences = 3;
+  double topicality = 0.5;
+  unsigned seed = 1;
+};
+
+void printUsage(const Options& o) {
+  cerr << "usage: gen_corpus -output <file> [options]\n"
+       << "  -format      fastText or labelDoc [" << o.format << "]\n"
+       << "  -examples    number of lines [" << o.examples << "]\n"
+       << "  -vocab       number of distinct words [" << o.vocab << "]\n"
+       << "  -zipf        exponent of the Zipf distribution of words [" << o.zipf << "]\n"
+       << "  -labels      number of labels (fastText) or topics (labelDoc) [" << o.labels << "]\n"
+       << "  -labelZipf   exponent of the Zipf distribution of labels [" << o.labelZipf << "]\n"
+       << "  -length      mean number of words of a document [" << o.length << "]\n"
+       << "  -sentences   labelDoc only: tab separated documents per line [" << o.sentences << "]\n"
+       << "  -topicality  fraction of the words drawn from the topic of the line [" << o.topicality << "]\n"
+       << "  -seed        random seed [" << o.seed << "]\n";
+}
+
+// Weights of ranks 1 to n in a Zipf distribution of exponent s.
+vector<double> zipfWeights(int n, double s) {
+  vector<double> weights(n);
+  for (int i = 0; i < n; i++) {
+    weights[i] = pow(i + 1.0, -s);
+  }
+  return weights;
+}
+
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      cerr << "Missing value for " << argv[i] << endl;
+      printUsage(o);
+      exit(EXIT_FAILURE);
+    }
+    if (strcmp(argv[i], "-output") == 0) {
+      o.output = argv[i + 1];
+    } else if (strcmp(argv[i], "-format") == 0) {
+      o.format = argv[i + 1];
+    } else if (strcmp(argv[i], "-examples") == 0) {
+      o.examples = atol(argv[i + 1]);
+    } else if (strcmp(argv[i], "-vocab") == 0) {
+      o.vocab = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-zipf") == 0) {
+      o.zipf = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "-labels") == 0) {
+      o.labels = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-labelZipf") == 0) {
+      o.labelZipf = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "-length") == 0) {
+      o.length = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-sentences") == 0) {
+      o.sentences = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-topicality") == 0) {
+      o.topicality = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "-seed") == 0) {
+      o.seed = atoi(argv[i + 1]);
+    } else {
+      cerr << "Unknown argument: " << argv[i] << endl;
+      printUsage(o);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (o.output.empty() || (o.format != "fastText" && o.format != "labelDoc") ||
+      o.examples < 0 || o.vocab < 1 || o.labels < 1 || o.length < 1 ||
+      o.sentences < 1) {
+    printUsage(o);
+    exit(EXIT_FAILURE);
+  }
+  ofstream out(o.output);
+  if (!out.is_open()) {
+    cerr << "Output file " << o.output << " cannot be opened for writing!\n";
+    exit(EXIT_FAILURE);
+  }
+
+  AliasTable words(zipfWeights(o.vocab, o.zipf));
+  AliasTable labels(zipfWeights(o.labels, o.labelZipf));
+  mt19937_64 rng(o.seed);
+  poisson_distribution<int> extraWords(o.length - 1);
+  uniform_real_distribution<double> uniform;
+  // The words of a topic are the common words of the vocabulary moved to
+  // another part of it, a different one for each topic.
+  const long topicShift = (std::max)(1, o.vocab / o.labels);
+
+  string line;
+  auto addDocument = [&](int topic) {
+    int n = 1 + extraWords(rng);
+    for (int i = 0; i < n; i++) {
+      long w = words.sample(rng());
+      if (uniform(rng) < o.topicality) {
+        w = (w + (topic + 1) * topicShift) % o.vocab;
+      }
+      if (i > 0) {
+        line += ' ';
+      }
+      line += 'w';
+      line += to_string(w);
+    }
+  };
+  for (long e = 0; e < o.examples; e++) {
+    line.clear();
+    int topic = labels.sample(rng());
+    if (o.format == "fastText") {
+      addDocument(topic);
+      line += " __label__";
+      line += to_string(topic);
+    } else {
+      for (int s = 0; s < o.sentences; s++) {
+        if (s > 0) {
+          line += '\t';
+        }
+        addDocument(topic);
+      }
+    }
+    line += '\n';
+    out << line;
+  }
+  if (!out) {
+    cerr << "Failed to write " << o.output << endl;
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Times normalize_text() against the original byte-at-a-time version on the tokens
+// of a file, or of a synthetic mix of words if none is given.
+
+#include "../utils/normalize.h"
+#include "../utils/utils.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+vector<string> syntheticTokens(size_t n) {
+  const vector<string> words = {
+    "the", "Quick", "BROWN", "fox", "jumps", "over", "a", "lazy", "dog",
+    "StarSpace", "embeddings", "2019", "$4.99", "iPhone7", "représentation",
+    "internationalization", "https://example.com/Some/Path", "__label__Sport"
+  };
+  minstd_rand rng(1);
+  vector<string> tokens(n);
+  for (auto& t : tokens) {
+    t = words[rng() % words.size()];
+  }
+  return tokens;
+}
+
+template<class F>
+double timeMs(const vector<string>& tokens, int rounds, F normalize) {
+  string scratch;
+  auto start = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const auto& t : tokens) {
+      scratch.assign(t);
+      normalize(scratch);
+    }
+  }
+  auto end = chrono::steady_clock::now();
+  return chrono::duration<double, milli>(end - start).count();
+}
+
+}
+
+int main(int argc, char** argv) {
+  vector<string> tokens;
+  if (argc > 1) {
+    ifstream in(argv[1]);
+    if (!in.is_open()) {
+      cerr << "Cannot open " << argv[1] << endl;
+      return 1;
+    }
+    string line;
+    vector<boost::string_view> parts;
+    while (getline(in, line)) {
+      split_tokens(line, "\t ", parts);
+      for (auto p : parts) {
+        if (!p.empty()) {
+          tokens.emplace_back(p.data(), p.size());
+        }
+      }
+    }
+  } else {
+    tokens = syntheticTokens(1000000);
+  }
+  size_t bytes = 0;
+  for (const auto& t : tokens) {
+    bytes += t.size();
+  }
+  const int rounds = 5;
+  cout << tokens.size() << " tokens, " << bytes << " bytes, "
+       << rounds << " rounds\n";
+
+  double scalar = timeMs(tokens, rounds, normalize_text_scalar);
+  double simd = timeMs(tokens, rounds, normalize_text);
+  double hashed = timeMs(tokens, rounds,
+                         [](string& s) { normalize_text_hash(s); });
+  double mb = double(bytes) * rounds / 1e6;
+  cout << "original:    " << scalar << " ms, " << mb / scalar * 1e3 << " MB/s\n";
+  cout << "vectorized:  " << simd << " ms, " << mb / simd * 1e3 << " MB/s\n";
+  cout << "with hash:   " << hashed << " ms, " << mb / hashed * 1e3 << " MB/s\n";
+  return 0;
+}
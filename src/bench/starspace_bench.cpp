@@ -0,0 +1,362 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Microbenchmarks of the kernels training and serving spend their time in,
+// on synthetic dictionaries, examples and embeddings, so that they run
+// anywhere. Built and run by "make bench"; pass Google Benchmark flags in
+// BENCH_ARGS, e.g. make bench BENCH_ARGS=--benchmark_filter=Train.
+
+#include "../starspace.h"
+#include "../utils/normalize.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+const int kWords = 20000;
+const int kLabels = 1000;
+const int kExamples = 10000;
+const int kWordsPerExample = 20;
+
+// Silences cout, which loading data and models writes its progress to.
+class QuietCout {
+public:
+  QuietCout() : saved_(cout.rdbuf(nullptr)) {}
+  ~QuietCout() { cout.rdbuf(saved_); }
+private:
+  streambuf* saved_;
+};
+
+shared_ptr<Args> benchArgs(int dim) {
+  auto args = make_shared<Args>();
+  args->dim = dim;
+  args->bucket = 100000;
+  return args;
+}
+
+string word(int i) { return "w" + to_string(i); }
+string label(int i) { return "__label__" + to_string(i); }
+
+// Ids drawn from a Zipf distribution over [0, n).
+class Zipf {
+public:
+  explicit Zipf(int n) {
+    vector<double> weights(n);
+    for (int i = 0; i < n; i++) {
+      weights[i] = 1.0 / (i + 1);
+    }
+    dist_ = discrete_distribution<int>(weights.begin(), weights.end());
+  }
+  int operator()(minstd_rand& rng) { return dist_(rng); }
+private:
+  discrete_distribution<int> dist_;
+};
+
+// Words w0 ... w(words - 1), then labels.
+shared_ptr<Dictionary> benchDict(
+    shared_ptr<Args> args, int words, int labels) {
+  auto dict = make_shared<Dictionary>(args);
+  for (int i = 0; i < words; i++) {
+    dict->insert(word(i));
+  }
+  for (int i = 0; i < labels; i++) {
+    dict->insert(label(i));
+  }
+  dict->threshold(1, 1);
+  return dict;
+}
+
+// Lines of the fastText format: Zipf distributed words and one label.
+vector<string> benchLines(int n, int length, unsigned seed = 1) {
+  minstd_rand rng(seed);
+  Zipf zipf(kWords);
+  vector<string> lines(n);
+  for (auto& line : lines) {
+    for (int i = 0; i < length; i++) {
+      line += word(zipf(rng)) + " ";
+    }
+    line += label(rng() % kLabels);
+  }
+  return lines;
+}
+
+// The training examples of benchLines, ready to train on.
+shared_ptr<InternDataHandler> benchData(
+    shared_ptr<Args> args, shared_ptr<Dictionary> dict) {
+  DataParser parser(dict, args);
+  vector<Corpus> corpora(1);
+  ParseResults ex;
+  for (const auto& line : benchLines(kExamples, kWordsPerExample)) {
+    ex.clear();
+    if (parser.parse(line, ex)) {
+      corpora[0].push_back(ex);
+    }
+  }
+  auto data = make_shared<InternDataHandler>(args);
+  QuietCout quiet;
+  data->addCorpora(corpora, "bench");
+  data->initRHSNegatives();
+  return data;
+}
+
+Matrix<Real> randomPoint(int dim) {
+  return Matrix<Real>({ 1, size_t(dim) }, 1.0);
+}
+
+void denseArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({ "dim" });
+  for (int dim : { 50, 100, 300 }) {
+    b->Args({ dim });
+  }
+}
+
+// Every combination of dim, batch size and negSearchLimit.
+void trainArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({ "dim", "batch", "neg" });
+  b->ArgsProduct({ { 50, 100, 300 }, { 1, 5, 32 }, { 10, 50, 200 } });
+}
+
+}
+
+static void BM_SparseLinearForwardIds(benchmark::State& state) {
+  const int dim = state.range(0), tokens = state.range(1);
+  SparseLinear<Real> table({ size_t(kWords), size_t(dim) }, 0.1);
+  minstd_rand rng(1);
+  Zipf zipf(kWords);
+  vector<int> ids(tokens);
+  for (auto& id : ids) {
+    id = zipf(rng);
+  }
+  Matrix<Real> out;
+  for (auto _ : state) {
+    table.forward(ids, out);
+    benchmark::DoNotOptimize(out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * tokens);
+}
+BENCHMARK(BM_SparseLinearForwardIds)
+  ->ArgNames({ "dim", "tokens" })
+  ->ArgsProduct({ { 50, 100, 300 }, { 10, 100 } });
+
+static void BM_SparseLinearForwardWeighted(benchmark::State& state) {
+  const int dim = state.range(0), tokens = state.range(1);
+  SparseLinear<Real> table({ size_t(kWords), size_t(dim) }, 0.1);
+  minstd_rand rng(1);
+  Zipf zipf(kWords);
+  vector<pair<int, Real>> ids(tokens);
+  for (auto& id : ids) {
+    id = { zipf(rng), 0.5 + (rng() % 100) / 100.0 };
+  }
+  Matrix<Real> out;
+  for (auto _ : state) {
+    table.forward(ids, out);
+    benchmark::DoNotOptimize(out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * tokens);
+}
+BENCHMARK(BM_SparseLinearForwardWeighted)
+  ->ArgNames({ "dim", "tokens" })
+  ->ArgsProduct({ { 50, 100, 300 }, { 10, 100 } });
+
+static void BM_Similarity(benchmark::State& state) {
+  auto args = benchArgs(state.range(0));
+  args->similarity = state.range(1) ? "dot" : "cosine";
+  EmbedModel model(args, benchDict(args, 10, 1));
+  auto a = randomPoint(args->dim), b = randomPoint(args->dim);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(model.similarity(a, b));
+  }
+  state.SetLabel(args->similarity);
+}
+BENCHMARK(BM_Similarity)
+  ->ArgNames({ "dim", "dot" })
+  ->ArgsProduct({ { 50, 100, 300 }, { 0, 1 } });
+
+static void BM_Cosine(benchmark::State& state) {
+  const int dim = state.range(0);
+  auto a = randomPoint(dim), b = randomPoint(dim);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(EmbedModel::cosine(a, b));
+  }
+}
+BENCHMARK(BM_Cosine)->Apply(denseArgs);
+
+static void trainBatch(benchmark::State& state, const string& loss) {
+  auto args = benchArgs(state.range(0));
+  args->batchSize = state.range(1);
+  args->negSearchLimit = state.range(2);
+  args->loss = loss;
+  auto dict = benchDict(args, kWords, kLabels);
+  auto data = benchData(args, dict);
+  EmbedModel model(args, dict);
+
+  // Consecutive batches of the examples, over and over.
+  vector<vector<ParseResults>> batches(kExamples / args->batchSize);
+  for (size_t i = 0; i < batches.size() * args->batchSize; i++) {
+    ParseResults ex;
+    data->getExampleById(i, ex);
+    batches[i / args->batchSize].push_back(ex);
+  }
+  size_t next = 0;
+  for (auto _ : state) {
+    const auto& batch = batches[next++ % batches.size()];
+    if (loss == "softmax") {
+      model.trainNLLBatch(data, batch, args->negSearchLimit, 0.01);
+    } else {
+      model.trainOneBatch(data, batch, args->negSearchLimit, 0.01);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * args->batchSize);
+}
+
+static void BM_TrainOneBatch(benchmark::State& state) {
+  trainBatch(state, "hinge");
+}
+BENCHMARK(BM_TrainOneBatch)->Apply(trainArgs);
+
+static void BM_TrainNLLBatch(benchmark::State& state) {
+  trainBatch(state, "softmax");
+}
+BENCHMARK(BM_TrainNLLBatch)->Apply(trainArgs);
+
+static void BM_KNN(benchmark::State& state) {
+  auto args = benchArgs(state.range(0));
+  const int words = state.range(1);
+  EmbedModel model(args, benchDict(args, words, 0));
+  auto point = randomPoint(args->dim);
+  // The first query computes the norms of the rows, which are then cached.
+  model.findLHSLike(point, 5);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(model.findLHSLike(point, 5));
+  }
+  state.SetItemsProcessed(state.iterations() * words);
+}
+BENCHMARK(BM_KNN)
+  ->ArgNames({ "dim", "rows" })
+  ->ArgsProduct({ { 50, 100, 300 }, { 10000, 100000 } });
+
+static void BM_PredictOne(benchmark::State& state) {
+  const int dim = state.range(0), labels = state.range(1), words = 1000;
+  // A random model with one row per word and label, loaded from tsv.
+  char path[] = "/tmp/starspace_benchXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    state.SkipWithError("cannot create a temporary model file");
+    return;
+  }
+  close(fd);
+  {
+    ofstream out(path);
+    minstd_rand rng(1);
+    normal_distribution<float> normal;
+    auto writeRow = [&](const string& symbol) {
+      out << symbol;
+      for (int j = 0; j < dim; j++) {
+        out << '\t' << normal(rng);
+      }
+      out << '\n';
+    };
+    for (int i = 0; i < words; i++) {
+      writeRow(word(i));
+    }
+    for (int i = 0; i < labels; i++) {
+      writeRow(label(i));
+    }
+  }
+  auto args = benchArgs(dim);
+  StarSpace sp(args);
+  {
+    QuietCout quiet;
+    sp.initFromTsv(path);
+    sp.loadBaseDocs();
+  }
+  remove(path);
+
+  minstd_rand rng(1);
+  Zipf zipf(words);
+  vector<Base> input;
+  for (int i = 0; i < kWordsPerExample; i++) {
+    input.emplace_back(zipf(rng), 1.0);
+  }
+  vector<Predictions> pred;
+  for (auto _ : state) {
+    pred.clear();
+    sp.predictOne(input, pred);
+  }
+  state.SetItemsProcessed(state.iterations() * labels);
+}
+BENCHMARK(BM_PredictOne)
+  ->ArgNames({ "dim", "labels" })
+  ->ArgsProduct({ { 50, 100, 300 }, { 100, 1000, 10000 } });
+
+static void BM_Parse(benchmark::State& state) {
+  const int length = state.range(0);
+  auto args = benchArgs(10);
+  args->ngrams = state.range(1);
+  DataParser parser(benchDict(args, kWords, kLabels), args);
+  auto lines = benchLines(1000, length);
+  ParseResults ex;
+  size_t bytes = 0, next = 0;
+  for (auto _ : state) {
+    const auto& line = lines[next++ % lines.size()];
+    ex.clear();
+    parser.parse(line, ex);
+    bytes += line.size();
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Parse)
+  ->ArgNames({ "tokens", "ngrams" })
+  ->ArgsProduct({ { 10, 100 }, { 1, 2 } });
+
+static void BM_GetId(benchmark::State& state) {
+  const int words = state.range(0);
+  auto args = benchArgs(10);
+  auto dict = benchDict(args, words, 0);
+  // Zipf distributed lookups, and one in ten misses.
+  minstd_rand rng(1);
+  Zipf zipf(words);
+  vector<string> queries(10000);
+  for (size_t i = 0; i < queries.size(); i++) {
+    queries[i] = (i % 10 == 9) ? "missing" + to_string(i) : word(zipf(rng));
+  }
+  size_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dict->getId(queries[next++ % queries.size()]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetId)->ArgName("words")->Arg(1000)->Arg(100000)->Arg(1000000);
+
+static void BM_NormalizeText(benchmark::State& state) {
+  const vector<string> words = {
+    "the", "Quick", "BROWN", "fox", "jumps", "over", "a", "lazy", "dog",
+    "StarSpace", "embeddings", "2019", "$4.99", "iPhone7", "représentation",
+    "internationalization", "https://example.com/Some/Path", "__label__Sport"
+  };
+  string scratch;
+  size_t bytes = 0, next = 0;
+  for (auto _ : state) {
+    scratch.assign(words[next++ % words.size()]);
+    normalize_text(scratch);
+    bytes += scratch.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_NormalizeText);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "checkpointer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace starspace {
+
+using namespace std;
+
+Checkpointer::Checkpointer(
+    shared_ptr<EmbedModel> model,
+    Writer write,
+    const vector<string>& suffixes,
+    int keep)
+  : model_(model)
+  , write_(write)
+  , suffixes_(suffixes)
+  , keep_(keep)
+  , stopTimer_(false) {
+  // The model itself is always written.
+  suffixes_.insert(suffixes_.begin(), "");
+}
+
+Checkpointer::~Checkpointer() {
+  finish();
+}
+
+void Checkpointer::save(const string& filename) {
+  std::lock_guard<std::mutex> lock(saveMutex_);
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+  auto snapshot = model_->snapshot();
+  writer_ = thread([=] { write(snapshot, filename); });
+}
+
+void Checkpointer::write(shared_ptr<EmbedModel> snapshot, const string& name) {
+  const string tmp = name + ".tmp";
+  write_(*snapshot, tmp);
+  for (const auto& suffix : suffixes_) {
+    if (rename((tmp + suffix).c_str(), (name + suffix).c_str()) != 0) {
+      cerr << "Could not move checkpoint to " << name + suffix << endl;
+    }
+  }
+
+  // Writes never overlap (each one is joined before the next starts), so
+  // written_ needs no lock of its own.
+  if (std::find(written_.begin(), written_.end(), name) != written_.end()) {
+    return;
+  }
+  written_.push_back(name);
+  while (keep_ > 0 && written_.size() > (size_t)keep_) {
+    for (const auto& suffix : suffixes_) {
+      remove((written_.front() + suffix).c_str());
+    }
+    written_.pop_front();
+  }
+}
+
+void Checkpointer::startTimer(double interval, const string& prefix) {
+  timer_ = thread([=] {
+    auto period = chrono::duration<double>(interval);
+    for (int n = 1; ; n++) {
+      {
+        std::unique_lock<std::mutex> lock(timerMutex_);
+        if (timerCv_.wait_for(lock, period, [&] { return stopTimer_; })) {
+          return;
+        }
+      }
+      cout << "\nSaving checkpoint " << prefix + "_ckpt" + to_string(n)
+           << endl;
+      save(prefix + "_ckpt" + to_string(n));
+    }
+  });
+}
+
+void Checkpointer::finish() {
+  {
+    std::lock_guard<std::mutex> lock(timerMutex_);
+    stopTimer_ = true;
+  }
+  timerCv_.notify_all();
+  if (timer_.joinable()) {
+    timer_.join();
+  }
+  std::lock_guard<std::mutex> lock(saveMutex_);
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Checkpointer saves intermediate models while training goes on. Saving a
+ * checkpoint only copies the lookup tables; the copy is then written on a
+ * background thread, first to a temporary file which is renamed once it
+ * is complete.
+ *
+ * Checkpoints can be requested explicitly (e.g. between epochs), or taken
+ * every few seconds by a timer. Timer checkpoints copy the tables while
+ * the training threads keep updating them, which is no less consistent
+ * than the lock-free updates themselves.
+ */
+
+#pragma once
+
+#include "model.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace starspace {
+
+class Checkpointer {
+public:
+  // write saves a model to the given file name, plus any companion files
+  // named by appending one of the given suffixes (e.g. ".tsv").
+  typedef std::function<void(const EmbedModel&, const std::string&)> Writer;
+
+  Checkpointer(
+      std::shared_ptr<EmbedModel> model,
+      Writer write,
+      const std::vector<std::string>& suffixes,
+      int keep);
+  ~Checkpointer();
+
+  // Copy the model and write it to filename in the background. Waits for
+  // the previous checkpoint to be written first.
+  void save(const std::string& filename);
+
+  // Also save every interval seconds, to prefix + "_ckpt<n>".
+  void startTimer(double interval, const std::string& prefix);
+
+  // Stop the timer and wait for the pending checkpoint to be written.
+  void finish();
+
+private:
+  void write(std::shared_ptr<EmbedModel> snapshot, const std::string& name);
+
+  std::shared_ptr<EmbedModel> model_;
+  Writer write_;
+  std::vector<std::string> suffixes_;
+  // Number of uniquely named checkpoints to keep on disk; 0 keeps all.
+  int keep_;
+
+  std::mutex saveMutex_;
+  std::thread writer_;
+  std::deque<std::string> written_;
+
+  std::mutex timerMutex_;
+  std::condition_variable timerCv_;
+  bool stopTimer_;
+  std::thread timer_;
+};
+
+}
@@ -9,7 +9,12 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <algorithm>
+#include <iterator>
 #include <numeric>
+#include <cmath>
+#include <unordered_map>
+#include <cstring>
 #include <assert.h>
 
 using namespace std;
@@ -36,16 +41,20 @@ void InternDataHandler::loadFromFile(
   const string& fileName,
   shared_ptr<DataParser> parser) {
 
-  vector<Corpus> corpora(args_->thread);
+  // One corpus per thread id, merged into examples_ at the end.
+  const int numThreads = std::max(args_->thread, 1);
+  vector<Corpus> corpora(numThreads);
+  vector<ParseResults> scratch(numThreads);
   if (args_->compressFile == "gzip") {
     foreach_line_gz(
       fileName,
       args_->numGzFile,
-      [&](std::string& line) {
-        auto& corpus = corpora[getThreadID()];
-        ParseResults example;
+      [&](boost::string_view line) {
+        auto& example = scratch[getThreadID()];
+        example.clear();
         if (parser->parse(line, example)) {
-          corpus.push_back(example);
+          // A copy allocates every vector at its exact size.
+          corpora[getThreadID()].push_back(example);
         }
       },
       args_->thread
@@ -61,24 +70,38 @@ void InternDataHandler::loadFromFile(
     cout << "Loading data from file : " << fileName << endl;
     foreach_line(
       fileName,
-      [&](std::string& line) {
-        auto& corpus = corpora[getThreadID()];
-        ParseResults example;
+      [&](boost::string_view line) {
+        auto& example = scratch[getThreadID()];
+        example.clear();
         if (parser->parse(line, example)) {
-          corpus.push_back(example);
+          // A copy allocates every vector at its exact size.
+          corpora[getThreadID()].push_back(example);
         }
       },
       args_->thread
     );
   }
-  // Glue corpora together.
+  addCorpora(corpora, fileName);
+}
+
+void InternDataHandler::addCorpora(
+    vector<Corpus>& corpora,
+    const string& fileName) {
+  // Glue corpora together, moving the examples so that their tokens are
+  // never copied, and releasing each corpus as soon as it is moved.
   auto totalSize = std::accumulate(corpora.begin(), corpora.end(), size_t(0),
-                     [](size_t l, Corpus& r) { return l + r.size(); });
-  size_t destCursor = examples_.size();
-  examples_.resize(totalSize + examples_.size());
-  for (const auto &subcorp: corpora) {
-    std::copy(subcorp.begin(), subcorp.end(), examples_.begin() + destCursor);
-    destCursor += subcorp.size();
+                     [](size_t l, const Corpus& r) { return l + r.size(); });
+  auto whole = std::find_if(corpora.begin(), corpora.end(),
+                 [&](const Corpus& c) { return c.size() == totalSize; });
+  if (examples_.empty() && whole != corpora.end()) {
+    // All examples are in one corpus: take it over as is.
+    examples_.swap(*whole);
+  } else {
+    examples_.reserve(examples_.size() + totalSize);
+    for (auto& subcorp: corpora) {
+      std::move(subcorp.begin(), subcorp.end(), std::back_inserter(examples_));
+      Corpus().swap(subcorp);
+    }
   }
   cout << "Total number of examples loaded : " << examples_.size() << endl;
   size_ = examples_.size();
@@ -189,6 +212,7 @@ void InternDataHandler::addExample(const ParseResults& example) {
 void InternDataHandler::getExampleById(int32_t idx, ParseResults& rslt) const {
   assert(idx < size_);
   convert(examples_[idx], rslt);
+  rslt.source = idx;
 }
 
 void InternDataHandler::getNextExample(ParseResults& rslt) {
@@ -199,12 +223,14 @@ void InternDataHandler::getNextExample(ParseResults& rslt) {
     idx_ = idx_ - size_;
   }
   convert(examples_[idx_], rslt);
+  rslt.source = idx_;
 }
 
 void InternDataHandler::getRandomExample(ParseResults& rslt) const {
   assert(size_ > 0);
   int32_t idx = rand() % size_;
   convert(examples_[idx], rslt);
+  rslt.source = idx;
 }
 
 void InternDataHandler::getKRandomExamples(int K, vector<ParseResults>& c) {
@@ -222,50 +248,215 @@ void InternDataHandler::getNextKExamples(int K, vector<ParseResults>& c) {
     idx_ = (idx_ + 1) % size_;
     ParseResults example;
     convert(examples_[idx_], example);
+    example.source = idx_;
     c.push_back(example);
   }
 }
 
-void InternDataHandler::getRandomWord(vector<Base>& result) {
-  result.push_back(word_negatives_[word_iter_]);
-  word_iter_++;
-  if (word_iter_ >= (int)word_negatives_.size()) {
-    word_iter_ = 0;
+void InternDataHandler::getRandomWord(vector<Base>& result) const {
+  assert(!wordNegatives_.empty());
+  result.emplace_back(wordNegatives_.sample(), 1.0);
+}
+
+// Words are sampled in proportion to their count in the dictionary raised
+// to -wordNegPower.
+void InternDataHandler::initWordNegatives(const Dictionary& dict) {
+  if (dict.nwords() == 0) {
+    cerr << "The dictionary has no words to sample word negatives from."
+         << endl;
+    exit(EXIT_FAILURE);
+  }
+  // Words come first in the dictionary.
+  vector<double> weights(dict.nwords());
+  for (int32_t i = 0; i < dict.nwords(); i++) {
+    auto count = (std::max)(dict.getCount(i), int64_t(1));
+    weights[i] = pow(double(count), args_->wordNegPower);
   }
+  wordNegatives_ = AliasTable(weights);
 }
 
-void InternDataHandler::initWordNegatives() {
-  word_iter_ = 0;
-  word_negatives_.clear();
-  assert(size_ > 0);
-  for (int i = 0; i < MAX_WORD_NEGATIVES_SIZE; i++) {
-    word_negatives_.emplace_back(genRandomWord());
+size_t InternDataHandler::examplesMemoryUsage() const {
+  auto bytes = [](const vector<Base>& v) {
+    return v.capacity() * sizeof(Base);
+  };
+  size_t retval = examples_.capacity() * sizeof(ParseResults);
+  for (const auto& ex : examples_) {
+    retval += bytes(ex.LHSTokens) + bytes(ex.RHSTokens);
+    retval += ex.RHSFeatures.capacity() * sizeof(vector<Base>);
+    for (const auto& feats : ex.RHSFeatures) {
+      retval += bytes(feats);
+    }
   }
+  return retval;
 }
 
-Base InternDataHandler::genRandomWord() const {
-  assert(size_ > 0);
-  auto& ex = examples_[rand() % size_];
-  int r = rand() % ex.LHSTokens.size();
-  return ex.LHSTokens[r];
+size_t InternDataHandler::negativesMemoryUsage() const {
+  return wordNegatives_.memoryUsage() + rhsNegatives_.memoryUsage()
+       + rhsNegRefs_.capacity() * sizeof(RHSRef);
 }
 
-// Randomly sample one example and randomly sample a label from this example
-// The result is usually used as negative samples in training
-void InternDataHandler::getRandomRHS(vector<Base>& results) const {
-  assert(size_ > 0);
+void InternDataHandler::buildRHSCandidate(
+    const RHSRef& ref,
+    vector<Base>& results) const {
+  const auto& example = examples_[ref.example];
   results.clear();
-  auto& ex = examples_[rand() % size_];
-  unsigned int r = rand() % ex.RHSTokens.size();
+  auto append = [&](size_t i) {
+    auto part = getRHSPart(example, i);
+    results.insert(results.end(), part.first, part.second);
+  };
   if (args_->trainMode == 2) {
-    for (unsigned int i = 0; i < ex.RHSTokens.size(); i++) {
-      if (i != r) {
-        results.push_back(ex.RHSTokens[i]);
+    const size_t n = numRHSParts(example);
+    for (size_t i = 0; i < n; i++) {
+      if (i != size_t(ref.part)) {
+        append(i);
       }
     }
   } else {
-    results.push_back(ex.RHSTokens[r]);
+    append(ref.part);
+  }
+}
+
+bool InternDataHandler::rhsCandidateOverlaps(int32_t i, int32_t idx) const {
+  const auto& ref = rhsNegRefs_[i];
+  const auto& from = examples_[ref.example];
+  const auto& example = examples_[idx];
+  const size_t numParts = numRHSParts(example);
+  for (size_t p = 0; p < numRHSParts(from); p++) {
+    const bool inCandidate = (args_->trainMode == 2) ?
+      p != size_t(ref.part) : p == size_t(ref.part);
+    if (!inCandidate) {
+      continue;
+    }
+    auto part = getRHSPart(from, p);
+    for (size_t q = 0; q < numParts; q++) {
+      auto other = getRHSPart(example, q);
+      if (part.second - part.first == other.second - other.first &&
+          std::equal(part.first, part.second, other.first)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+namespace {
+
+// Polynomial hash of a sequence of tokens, with the power of the base for
+// its length, so that the hash of a concatenation can be computed from the
+// hashes of its parts.
+struct RangeHash {
+  uint64_t hash = 0;
+  uint64_t scale = 1;
+
+  void append(const RangeHash& other) {
+    hash = hash * other.scale + other.hash;
+    scale *= other.scale;
+  }
+};
+
+RangeHash hashRange(const Base* begin, const Base* end) {
+  const uint64_t kBase = 1099511628211ULL;
+  RangeHash h;
+  for (auto t = begin; t != end; t++) {
+    uint32_t w;
+    memcpy(&w, &t->second, sizeof(w));
+    uint64_t token = (uint64_t(uint32_t(t->first)) << 32) | w;
+    h.hash = h.hash * kBase + token * 0x9e3779b97f4a7c15ULL;
+    h.scale *= kBase;
   }
+  return h;
+}
+
+}
+
+/*
+ * Negatives used to be drawn by picking a random example, then one of its
+ * RHS candidates. The sampler keeps that distribution: every distinct
+ * candidate is weighted by its share of the examples, each example sharing
+ * a weight of one among its candidates. -labelNegPower then smooths these
+ * weights.
+ * Candidates are only built to tell apart those with the same hash. With
+ * trainMode 2, the hash of each candidate is combined from the hashes of
+ * the parts before and after the one it leaves out, so an example costs
+ * time linear in its size.
+ */
+void InternDataHandler::initRHSNegatives() {
+  assert(size_ > 0);
+  rhsNegRefs_.clear();
+  vector<double> weights;
+  // Candidates by hash, chained through next on collisions.
+  unordered_map<uint64_t, int32_t> first;
+  vector<int32_t> next;
+  vector<Base> candidate, other;
+  auto findOrAdd = [&](const RHSRef& ref, uint64_t h) {
+    auto it = first.find(h);
+    int32_t i = (it == first.end()) ? -1 : it->second;
+    if (i >= 0) {
+      buildRHSCandidate(ref, candidate);
+    }
+    for (; i >= 0; i = next[i]) {
+      buildRHSCandidate(rhsNegRefs_[i], other);
+      if (candidate == other) {
+        return i;
+      }
+    }
+    i = weights.size();
+    next.push_back(it == first.end() ? -1 : it->second);
+    first[h] = i;
+    weights.push_back(0.0);
+    rhsNegRefs_.push_back(ref);
+    return i;
+  };
+
+  vector<RangeHash> parts, suffixes;
+  vector<int32_t> ids;
+  for (size_t e = 0; e < examples_.size(); e++) {
+    const auto& example = examples_[e];
+    const size_t n = numRHSParts(example);
+    parts.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      auto part = getRHSPart(example, i);
+      parts[i] = hashRange(part.first, part.second);
+    }
+    if (args_->trainMode == 2) {
+      // suffixes[i] joins parts i to n - 1.
+      suffixes.assign(n + 1, RangeHash());
+      for (size_t i = n; i-- > 0;) {
+        suffixes[i] = parts[i];
+        suffixes[i].append(suffixes[i + 1]);
+      }
+    }
+    ids.clear();
+    RangeHash prefix;
+    for (size_t r = 0; r < n; r++) {
+      RangeHash h = parts[r];
+      if (args_->trainMode == 2) {
+        h = prefix;
+        h.append(suffixes[r + 1]);
+        prefix.append(parts[r]);
+      }
+      ids.push_back(findOrAdd(RHSRef{int32_t(e), int32_t(r)}, h.hash));
+    }
+    for (auto i : ids) {
+      weights[i] += 1.0 / ids.size();
+    }
+  }
+  if (weights.empty()) {
+    cerr << "The examples have no RHS to sample negatives from." << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (args_->labelNegPower != 1.0) {
+    for (auto& w : weights) {
+      w = pow(w, args_->labelNegPower);
+    }
+  }
+  rhsNegatives_ = AliasTable(weights);
+  rhsNegRefs_.shrink_to_fit();
+}
+
+void InternDataHandler::getRandomRHS(vector<Base>& results) const {
+  assert(!rhsNegatives_.empty());
+  getRHSCandidate(rhsNegatives_.sample(), results);
 }
 
 void InternDataHandler::save(std::ostream& out) {
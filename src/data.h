@@ -10,6 +10,7 @@
 #include "dict.h"
 #include "parser.h"
 #include "utils/utils.h"
+#include "utils/alias_table.h"
 #include <string>
 #include <vector>
 #include <fstream>
@@ -23,10 +24,30 @@ public:
   virtual void loadFromFile(const std::string& file,
                             std::shared_ptr<DataParser> parser);
 
+  // Append the examples of corpora, which were parsed from fileName. The
+  // examples are moved out, leaving corpora empty.
+  void addCorpora(
+      std::vector<Corpus>& corpora,
+      const std::string& fileName);
+
   virtual void convert(const ParseResults& example, ParseResults& rslt) const;
 
+  // Build the sampler of RHS negatives from the examples. getRandomRHS
+  // replaces results by a negative drawn from it; it is safe to call from
+  // many threads. Candidates refer to the examples, so the sampler must be
+  // built again if they change.
+  void initRHSNegatives();
+  bool hasRHSNegatives() const { return !rhsNegatives_.empty(); }
   virtual void getRandomRHS(std::vector<Base>& results)
     const;
+  // The distinct RHS candidates negatives are drawn from.
+  size_t numRHSCandidates() const { return rhsNegRefs_.size(); }
+  void getRHSCandidate(int32_t i, std::vector<Base>& results) const {
+    buildRHSCandidate(rhsNegRefs_[i], results);
+  }
+  // Whether RHS candidate i has a part (see numRHSParts) in common with the
+  // RHS of example idx, in which case it is no negative for that example.
+  bool rhsCandidateOverlaps(int32_t i, int32_t idx) const;
 
   virtual void save(std::ostream& out);
 
@@ -52,15 +73,39 @@ public:
 
   void errorOnZeroExample(const std::string& fileName);
 
-  void initWordNegatives();
-  void getRandomWord(std::vector<Base>& result);
+  // Build the sampler of word negatives, used by trainMode 5 and
+  // -trainWord, from the word counts of dict. getRandomWord appends a word
+  // drawn from it; it is safe to call from many threads.
+  void initWordNegatives(const Dictionary& dict);
+  bool hasWordNegatives() const { return !wordNegatives_.empty(); }
+  void getRandomWord(std::vector<Base>& result) const;
+
+  // Bytes held by the examples, and by the samplers of negatives.
+  size_t examplesMemoryUsage() const;
+  size_t negativesMemoryUsage() const;
 
 
 protected:
-  virtual Base genRandomWord() const;
+  typedef std::pair<const Base*, const Base*> TokenRange;
+  // The parts the RHS candidates of example are made of: its labels here.
+  // Candidate r of an example is its part r, or with trainMode 2 all its
+  // parts but r, joined.
+  virtual size_t numRHSParts(const ParseResults& example) const {
+    return example.RHSTokens.size();
+  }
+  virtual TokenRange getRHSPart(const ParseResults& example, size_t i) const {
+    const Base* part = example.RHSTokens.data() + i;
+    return TokenRange(part, part + 1);
+  }
+
+  // A candidate, as the index of its example and its part r.
+  struct RHSRef {
+    int32_t example;
+    int32_t part;
+  };
+  void buildRHSCandidate(const RHSRef& ref, std::vector<Base>& results) const;
 
   static const int32_t MAX_VOCAB_SIZE = 10000000;
-  static const int32_t MAX_WORD_NEGATIVES_SIZE = 10000000;
 
   std::shared_ptr<Args> args_;
   std::vector<ParseResults> examples_;
@@ -68,8 +113,12 @@ protected:
   int32_t idx_ = -1;
   int32_t size_ = 0;
 
-  int32_t word_iter_;
-  std::vector<Base> word_negatives_;
+  AliasTable wordNegatives_;
+
+  // The distinct RHS candidates of the examples, built from examples_ when
+  // they are drawn.
+  AliasTable rhsNegatives_;
+  std::vector<RHSRef> rhsNegRefs_;
 };
 
 }
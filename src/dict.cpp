@@ -7,6 +7,7 @@
 
 #include "dict.h"
 #include "parser.h"
+#include "utils/utils.h"
 
 #include <assert.h>
 #include <algorithm>
@@ -14,6 +15,12 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 using namespace boost::iostreams;
@@ -24,14 +31,15 @@ const std::string Dictionary::EOS = "</s>";
 const uint32_t Dictionary::HASH_C = 116049371;
 
 Dictionary::Dictionary(shared_ptr<Args> args) : args_(args),
-  hashToIndex_(MAX_VOCAB_SIZE, -1), size_(0), nwords_(0), nlabels_(0),
-  ntokens_(0)
+  table_(MIN_TABLE_SIZE, slot{0, -1}), size_(0), nwords_(0), nlabels_(0),
+  ntokens_(0), evictedCount_(0),
+  vocabLimit_(int64_t(0.75 * MAX_VOCAB_SIZE)), pruneIdxSize_(-1)
   {
     entryList_.clear();
   }
 
 // hash trick from fastText
-uint32_t Dictionary::hash(const std::string& str) const {
+uint32_t Dictionary::hash(boost::string_view str) {
   uint32_t h = 2166136261;
   for (size_t i = 0; i < str.size(); i++) {
     h = h ^ uint32_t(str[i]);
@@ -40,29 +48,57 @@ uint32_t Dictionary::hash(const std::string& str) const {
   return h;
 }
 
-int32_t Dictionary::find(const std::string& w) const {
-  int32_t h = hash(w) % MAX_VOCAB_SIZE;
-  while (hashToIndex_[h] != -1 && entryList_[hashToIndex_[h]].symbol != w) {
-    h = (h + 1) % MAX_VOCAB_SIZE;
+int32_t Dictionary::find(boost::string_view w) const {
+  return find(w, hash(w));
+}
+
+// Returns the slot holding w, or the empty slot where it would be inserted.
+int32_t Dictionary::find(boost::string_view w, uint32_t h) const {
+  const size_t mask = table_.size() - 1;
+  size_t pos = h & mask;
+  while (table_[pos].id != -1 &&
+         (table_[pos].hash != h ||
+          symbol(entryList_[table_[pos].id]) != w)) {
+    pos = (pos + 1) & mask;
   }
-  return h;
+  return pos;
 }
 
-int32_t Dictionary::getId(const string& symbol) const {
-  int32_t h = find(symbol);
-  return hashToIndex_[h];
+// Resize the table to fit entryList_ and re-insert every entry.
+void Dictionary::rebuildTable() {
+  size_t capacity = MIN_TABLE_SIZE;
+  while (capacity * 3 < entryList_.size() * 4) {
+    capacity *= 2;
+  }
+  table_.assign(capacity, slot{0, -1});
+  const size_t mask = capacity - 1;
+  for (size_t i = 0; i < entryList_.size(); i++) {
+    size_t pos = entryList_[i].hash & mask;
+    while (table_[pos].id != -1) {
+      pos = (pos + 1) & mask;
+    }
+    table_[pos] = slot{entryList_[i].hash, int32_t(i)};
+  }
+}
+
+int32_t Dictionary::getId(boost::string_view symbol) const {
+  return getId(symbol, hash(symbol));
 }
 
-const std::string& Dictionary::getSymbol(int32_t id) const {
+int32_t Dictionary::getId(boost::string_view symbol, uint32_t h) const {
+  return table_[find(symbol, h)].id;
+}
+
+boost::string_view Dictionary::getSymbol(int32_t id) const {
   assert(id >= 0);
   assert(id < size_);
-  return entryList_[id].symbol;
+  return symbol(entryList_[id]);
 }
 
-const std::string& Dictionary::getLabel(int32_t lid) const {
+boost::string_view Dictionary::getLabel(int32_t lid) const {
   assert(lid >= 0);
   assert(lid < nlabels_);
-  return entryList_[lid + nwords_].symbol;
+  return symbol(entryList_[lid + nwords_]);
 }
 
 entry_type Dictionary::getType(int32_t id) const {
@@ -71,23 +107,55 @@ entry_type Dictionary::getType(int32_t id) const {
   return entryList_[id].type;
 }
 
-entry_type Dictionary::getType(const string& w) const {
-  return (w.find(args_->label) == 0)? entry_type::label : entry_type::word;
+entry_type Dictionary::getType(boost::string_view w) const {
+  return w.starts_with(args_->label) ? entry_type::label : entry_type::word;
+}
+
+uint64_t Dictionary::addSymbol(boost::string_view s) {
+  uint64_t offset = symbols_.size();
+  symbols_.append(s.data(), s.size());
+  symbols_.push_back(0);
+  return offset;
+}
+
+void Dictionary::compactSymbols() {
+  string symbols;
+  symbols.reserve(symbols_.size());
+  for (auto& e : entryList_) {
+    uint64_t offset = symbols.size();
+    symbols.append(symbols_, e.offset, e.length);
+    symbols.push_back(0);
+    e.offset = offset;
+  }
+  symbols_.swap(symbols);
+  symbols_.shrink_to_fit();
+}
+
+int32_t Dictionary::insert(boost::string_view symbol) {
+  return insert(symbol, hash(symbol));
 }
 
-void Dictionary::insert(const string& symbol) {
-  int32_t h = find(symbol);
+int32_t Dictionary::insert(boost::string_view symbol, uint32_t h) {
+  int32_t pos = find(symbol, h);
   ntokens_++;
-  if (hashToIndex_[h] == -1) {
+  if (table_[pos].id == -1) {
     entry e;
-    e.symbol = symbol;
-    e.count = 1;
+    e.offset = addSymbol(symbol);
+    e.length = symbol.size();
     e.type = getType(symbol);
+    e.count = (e.type == entry_type::word) ? evictedCount_ + 1 : 1;
+    e.hash = h;
     entryList_.push_back(e);
-    hashToIndex_[h] = size_++;
-  } else {
-    entryList_[hashToIndex_[h]].count++;
+    int32_t id = size_++;
+    table_[pos] = slot{h, id};
+    if (entryList_.size() * 4 > table_.size() * 3) {
+      rebuildTable();
+    }
+    return id;
   }
+  int32_t id = table_[pos].id;
+  entryList_[id].count++;
+  return id;
 }
 
 void Dictionary::save(std::ostream& out) const {
@@ -97,7 +165,7 @@ void Dictionary::save(std::ostream& out) const {
   out.write((char*) &ntokens_, sizeof(int64_t));
   for (int32_t i = 0; i < size_; i++) {
     entry e = entryList_[i];
-    out.write(e.symbol.data(), e.symbol.size() * sizeof(char));
+    out.write(symbols_.data() + e.offset, e.length * sizeof(char));
     out.put(0);
     out.write((char*) &(e.count), sizeof(int64_t));
     out.write((char*) &(e.type), sizeof(entry_type));
@@ -106,7 +174,7 @@ void Dictionary::save(std::ostream& out) const {
 
 void Dictionary::load(std::istream& in) {
   entryList_.clear();
-  std::fill(hashToIndex_.begin(), hashToIndex_.end(), -1);
+  symbols_.clear();
   in.read((char*) &size_, sizeof(int32_t));
   in.read((char*) &nwords_, sizeof(int32_t));
   in.read((char*) &nlabels_, sizeof(int32_t));
@@ -114,87 +182,334 @@ void Dictionary::load(std::istream& in) {
   for (int32_t i = 0; i < size_; i++) {
     char c;
     entry e;
+    e.offset = symbols_.size();
     while ((c = in.get()) != 0) {
-      e.symbol.push_back(c);
+      symbols_.push_back(c);
     }
+    e.length = symbols_.size() - e.offset;
+    symbols_.push_back(0);
     in.read((char*) &e.count, sizeof(int64_t));
     in.read((char*) &e.type, sizeof(entry_type));
+    e.hash = hash(symbol(e));
     entryList_.push_back(e);
-    hashToIndex_[find(e.symbol)] = i;
+  }
+  rebuildTable();
+}
+
+void Dictionary::saveBinary(std::ostream& out) const {
+  out.write((char*) &size_, sizeof(int32_t));
+  out.write((char*) &nwords_, sizeof(int32_t));
+  out.write((char*) &nlabels_, sizeof(int32_t));
+  out.write((char*) &ntokens_, sizeof(int64_t));
+
+  // The arena is already in the saved layout.
+  vector<int64_t> counts(size_);
+  vector<entry_type> types(size_);
+  for (int32_t i = 0; i < size_; i++) {
+    counts[i] = entryList_[i].count;
+    types[i] = entryList_[i].type;
+  }
+  uint64_t arenaSize = symbols_.size();
+  out.write((char*) &arenaSize, sizeof(uint64_t));
+  out.write(symbols_.data(), arenaSize);
+  out.write((char*) counts.data(), size_ * sizeof(int64_t));
+  out.write((char*) types.data(), size_ * sizeof(entry_type));
+
+  uint64_t tableSize = table_.size();
+  out.write((char*) &tableSize, sizeof(uint64_t));
+  out.write((char*) table_.data(), tableSize * sizeof(slot));
+
+  // Kept buckets in the order of their ngram rows.
+  out.write((char*) &pruneIdxSize_, sizeof(int64_t));
+  out.write((char*) pruneIdx_.data(), pruneIdx_.size() * sizeof(int64_t));
+}
+
+void Dictionary::loadBinary(std::istream& in, bool withPruning) {
+  in.read((char*) &size_, sizeof(int32_t));
+  in.read((char*) &nwords_, sizeof(int32_t));
+  in.read((char*) &nlabels_, sizeof(int32_t));
+  in.read((char*) &ntokens_, sizeof(int64_t));
+
+  uint64_t arenaSize;
+  in.read((char*) &arenaSize, sizeof(uint64_t));
+  symbols_.assign(arenaSize, 0);
+  in.read(&symbols_[0], arenaSize);
+  vector<int64_t> counts(size_);
+  vector<entry_type> types(size_);
+  in.read((char*) counts.data(), size_ * sizeof(int64_t));
+  in.read((char*) types.data(), size_ * sizeof(entry_type));
+
+  uint64_t tableSize;
+  in.read((char*) &tableSize, sizeof(uint64_t));
+  table_.resize(tableSize);
+  in.read((char*) table_.data(), tableSize * sizeof(slot));
+  if (!in || tableSize == 0 || (tableSize & (tableSize - 1)) != 0) {
+    cerr << "Dictionary in model file is corrupted!" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  entryList_.resize(size_);
+  size_t pos = 0;
+  for (int32_t i = 0; i < size_; i++) {
+    auto end = symbols_.find('\0', pos);
+    if (end == string::npos) {
+      cerr << "Dictionary in model file is corrupted!" << endl;
+      exit(EXIT_FAILURE);
+    }
+    entryList_[i].offset = pos;
+    entryList_[i].length = end - pos;
+    entryList_[i].count = counts[i];
+    entryList_[i].type = types[i];
+    pos = end + 1;
+  }
+  // The hashes are already in the table; no need to recompute them.
+  for (const auto& s : table_) {
+    if (s.id >= size_) {
+      cerr << "Dictionary in model file is corrupted!" << endl;
+      exit(EXIT_FAILURE);
+    }
+    if (s.id != -1) {
+      entryList_[s.id].hash = s.hash;
+    }
+  }
+
+  pruneIdxSize_ = -1;
+  pruneIdx_.clear();
+  if (withPruning) {
+    in.read((char*) &pruneIdxSize_, sizeof(int64_t));
+    pruneIdx_.resize((std::max)(pruneIdxSize_, int64_t(0)));
+    in.read((char*) pruneIdx_.data(), pruneIdx_.size() * sizeof(int64_t));
+    if (!in || !std::is_sorted(pruneIdx_.begin(), pruneIdx_.end())) {
+      cerr << "Dictionary in model file is corrupted!" << endl;
+      exit(EXIT_FAILURE);
+    }
   }
 }
 
 /* Build dictionary from file.
- * In dictionary building process, if the current dictionary is at 75% capacity,
- * it automatically increases the threshold for both word and label.
+ * The file is split into one byte range per thread (or, for compressed
+ * input, into groups of files), and each thread counts the tokens of its
+ * share into a dictionary of its own. The shards are merged in order, so
+ * for a plain input file the result is the same as reading it on a single
+ * thread.
+ * In dictionary building process, if the merged shards could hold more
+ * than 75% of the capacity, they are merged, the threshold for both word and
+ * label is increased until the merged dictionary is back within it, and the
+ * symbols below the threshold are dropped from every shard. With a single
+ * thread this is the same as increasing the threshold whenever the
+ * dictionary outgrows the limit.
  * At the end the -minCount and -minCountLabel from arguments will be applied
  * as thresholds.
+ * With -dictBudget, a shard instead evicts its least frequent words when it
+ * holds more symbols than the budget (see evict()). The merged shards are
+ * then only candidates with approximate counts, which a second read of the
+ * file replaces by exact ones before the thresholds are applied.
+ * With corpora, every line is parsed into an example against its shard, and
+ * the examples are remapped to the final ids at the end. The shards then
+ * keep all symbols until the end, since their ids must not change.
  */
 void Dictionary::readFromFile(
     const std::string& file,
-    shared_ptr<DataParser> parser) {
+    shared_ptr<DataParser> parser,
+    vector<Corpus>* corpora) {
+
+  int numThreads = (std::max)(args_->thread, 1);
+  vector<Dictionary> shards(numThreads, Dictionary(args_));
+  vector<size_t> linesRead(numThreads, 0);
+  std::atomic<int64_t> tokensRead(0);
+  const bool bounded = args_->dictBudget > 0 && corpora == nullptr;
+  // Evicting shards are merged at the end, so together they stay within the
+  // limit.
+  const int64_t budget =
+    (std::min)(int64_t(args_->dictBudget), vocabLimit_ / numThreads);
+
+  if (corpora != nullptr) {
+    corpora->assign(numThreads, Corpus());
+    if (args_->dictBudget > 0) {
+      cerr << "-dictBudget is ignored when the file is read in a single pass."
+           << endl;
+    }
+  }
 
+  // Call onLine(i, line) for every line of the input, on thread i.
+  typedef std::function<void(int, boost::string_view)> LineFn;
+  auto readLines = [&](const LineFn& onLine) {
+    if (args_->compressFile == "gzip") {
+      auto files = gz_input_files(file, args_->numGzFile);
+      if (!read_gz_lines(files, onLine, numThreads)) {
+        cerr << "Input files cannot be opened!" << endl;
+        exit(EXIT_FAILURE);
+      }
+      return;
+    }
+    if (!read_lines(file, onLine, numThreads)) {
+      cerr << "Input file cannot be opened!" << endl;
+      exit(EXIT_FAILURE);
+    }
+  };
+
+  // The merged dictionary grows by at most the symbols added to the shards,
+  // so it is only merged once these exceed the room it had left.
+  std::atomic<int64_t> added(0);
+  std::atomic<int64_t> room(vocabLimit_);
   int64_t minThreshold = 1;
-  size_t lines_read = 0;
+  vector<std::mutex> shardMutexes(numThreads);
+  std::mutex thresholdMutex;
+  auto thresholdShards = [&]() {
+    std::lock_guard<std::mutex> lock(thresholdMutex);
+    if (added <= room) {
+      return;
+    }
+    vector<std::unique_lock<std::mutex>> shardLocks;
+    for (auto& m : shardMutexes) {
+      shardLocks.emplace_back(m);
+    }
+    Dictionary merged(args_);
+    for (const auto& shard : shards) {
+      merged.merge(shard);
+    }
+    if (merged.size_ > vocabLimit_) {
+      while (merged.size_ > vocabLimit_) {
+        minThreshold++;
+        merged.threshold(minThreshold, minThreshold);
+      }
+      for (auto& shard : shards) {
+        shard.retain(merged);
+      }
+    }
+    added = 0;
+    room = vocabLimit_ - merged.size_;
+  };
 
-  auto readFromInputStream = [&](std::istream& in) {
-    string line;
-    while (getline(in, line, '\n')) {
-      vector<string> tokens;
-      parser->parseForDict(line, tokens);
-      lines_read++;
-      for (auto token : tokens) {
-        insert(token);
-        if ((ntokens_ % 1000000 == 0) && args_->verbose) {
-          std::cerr << "\rRead " << ntokens_  / 1000000 << "M words" << std::flush;
+  // Count the tokens of one line into shard i.
+  vector<vector<string>> tokens(numThreads);
+  vector<ParseResults> scratch(numThreads);
+  auto countLine = [&](int i, boost::string_view line) {
+    auto& shard = shards[i];
+    int64_t counted = shard.ntokens_;
+    linesRead[i]++;
+    if (corpora != nullptr) {
+      auto& example = scratch[i];
+      example.clear();
+      parser->parseAndCount(line, example, shard);
+      (*corpora)[i].push_back(example);
+    } else if (bounded) {
+      tokens[i].clear();
+      parser->parseForDict(line, tokens[i]);
+      for (const auto& token : tokens[i]) {
+        shard.insert(token);
+        if (shard.size_ > budget) {
+          shard.evict(budget / 2);
         }
-        if (size_ > 0.75 * MAX_VOCAB_SIZE) {
-          minThreshold++;
-          threshold(minThreshold, minThreshold);
+      }
+    } else {
+      tokens[i].clear();
+      parser->parseForDict(line, tokens[i]);
+      {
+        std::lock_guard<std::mutex> lock(shardMutexes[i]);
+        int32_t size = shard.size_;
+        for (const auto& token : tokens[i]) {
+          shard.insert(token);
         }
+        added += shard.size_ - size;
       }
+      if (added > room) {
+        thresholdShards();
+      }
+    }
+    counted = shard.ntokens_ - counted;
+    int64_t before = tokensRead.fetch_add(counted);
+    if (args_->verbose &&
+        before / 1000000 != (before + counted) / 1000000) {
+      std::cerr << "\rRead " << (before + counted) / 1000000
+                << "M words" << std::flush;
     }
   };
 
-#ifdef COMPRESS_FILE
   if (args_->compressFile == "gzip") {
     cout << "Build dict from compressed input file.\n";
-    for (int i = 0; i < args_->numGzFile; i++) {
-      filtering_istream in;
-      auto str_idx = boost::str(boost::format("%02d") % i);
-      auto fname = file + str_idx + ".gz";
-      ifstream ifs(fname);
-      if (!ifs.good()) {
-        continue;
-      }
-      in.push(gzip_decompressor());
-      in.push(ifs);
-      readFromInputStream(in);
-      ifs.close();
-    }
   } else {
     cout << "Build dict from input file : " << file << endl;
-    ifstream fin(file);
-    if (!fin.is_open()) {
-      cerr << "Input file cannot be opened!" << endl;
-      exit(EXIT_FAILURE);
-    }
-    readFromInputStream(fin);
-    fin.close();
   }
-#else
-  cout << "Build dict from input file : " << file << endl;
-  ifstream fin(file);
-  if (!fin.is_open()) {
-    cerr << "Input file cannot be opened!" << endl;
-    exit(EXIT_FAILURE);
+  readLines(countLine);
+
+  size_t lines_read = 0;
+  int64_t evictedCount = 0;
+  for (int i = 0; i < numThreads; i++) {
+    merge(shards[i]);
+    lines_read += linesRead[i];
+    evictedCount += shards[i].evictedCount_;
+  }
+
+  if (evictedCount > 0) {
+    // A symbol may have been seen up to evictedCount more times than its
+    // merged count says, so keep every symbol that could reach the
+    // thresholds and count those exactly.
+    threshold((std::max)(args_->minCount - evictedCount, int64_t(1)),
+              (std::max)(args_->minCountLabel - evictedCount, int64_t(1)));
+    cout << "Recount " << size_ << " candidate symbols" << endl;
+    for (auto& shard : shards) {
+      shard.entryList_.clear();
+      shard.computeCounts();
+    }
+    // One count per candidate, shared by the threads.
+    unique_ptr<std::atomic<int64_t>[]> counts(
+        new std::atomic<int64_t>[size_]);
+    for (int32_t id = 0; id < size_; id++) {
+      counts[id].store(0, std::memory_order_relaxed);
+    }
+    readLines([&](int i, boost::string_view line) {
+      tokens[i].clear();
+      parser->parseForDict(line, tokens[i]);
+      for (const auto& token : tokens[i]) {
+        int32_t id = getId(token);
+        if (id >= 0) {
+          counts[id].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+    for (int32_t id = 0; id < size_; id++) {
+      entryList_[id].count = counts[id].load(std::memory_order_relaxed);
+    }
+    if (args_->minCount <= evictedCount ||
+        args_->minCountLabel <= evictedCount) {
+      cerr << "Warning: with -dictBudget " << args_->dictBudget
+           << ", symbols seen up to " << evictedCount
+           << " times may be missing from the dictionary." << endl;
+    }
   }
-  readFromInputStream(fin);
-  fin.close();
-#endif
 
   threshold(args_->minCount, args_->minCountLabel);
 
+  if (corpora != nullptr) {
+    // Translate the examples of every shard to the final ids, dropping
+    // those no longer valid.
+    vector<thread> threads;
+    for (int i = 0; i < numThreads; i++) {
+      threads.emplace_back([&, i]() {
+        const auto& shard = shards[i];
+        vector<int32_t> toFinal(shard.size_);
+        for (int32_t id = 0; id < shard.size_; id++) {
+          toFinal[id] = getId(shard.symbol(shard.entryList_[id]));
+        }
+        auto& corpus = (*corpora)[i];
+        size_t kept = 0;
+        for (size_t j = 0; j < corpus.size(); j++) {
+          if (parser->remap(corpus[j], toFinal, *this)) {
+            if (kept != j) {
+              corpus[kept] = std::move(corpus[j]);
+            }
+            kept++;
+          }
+        }
+        corpus.resize(kept);
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
   std::cerr << "\rRead " << ntokens_  / 1000000 << "M words" << std::endl;
   std::cerr << "Number of words in dictionary:  " << nwords_ << std::endl;
   std::cerr << "Number of labels in dictionary: " << nlabels_ << std::endl;
@@ -209,6 +524,11 @@ void Dictionary::readFromFile(
   }
 }
 
+size_t Dictionary::memoryUsage() const {
+  return entryList_.capacity() * sizeof(entry) + symbols_.capacity()
+       + table_.capacity() * sizeof(slot);
+}
+
 // Sort the dictionary by [word, label] order and by number of occurance.
 // Removes word / label that does not pass respective threshold.
 void Dictionary::threshold(int64_t t, int64_t tl) {
@@ -226,31 +546,122 @@ void Dictionary::threshold(int64_t t, int64_t tl) {
   computeCounts();
 }
 
+// Drop the least frequent words, keeping at most keep of them. Words seen
+// from then on start from the largest count dropped so far, so that counts
+// never fall below the number of occurrences of a symbol.
+void Dictionary::evict(int64_t keep) {
+  vector<int64_t> counts;
+  counts.reserve(nwords_);
+  for (const auto& e : entryList_) {
+    if (e.type == entry_type::word) {
+      counts.push_back(e.count);
+    }
+  }
+  if (int64_t(counts.size()) <= keep) {
+    return;
+  }
+  // The cut is the count of the keep-th most frequent word; ties with it
+  // are dropped too.
+  auto cut = counts.begin() + (counts.size() - keep - 1);
+  std::nth_element(counts.begin(), cut, counts.end());
+  int64_t maxDropped = *cut;
+  entryList_.erase(remove_if(entryList_.begin(), entryList_.end(), [&](const entry& e) {
+        return e.type == entry_type::word && e.count <= maxDropped;
+      }), entryList_.end());
+  evictedCount_ = (std::max)(evictedCount_, maxDropped);
+  computeCounts();
+}
+
+// Drop the entries whose symbol is not in kept.
+void Dictionary::retain(const Dictionary& kept) {
+  entryList_.erase(remove_if(entryList_.begin(), entryList_.end(), [&](const entry& e) {
+        return kept.getId(symbol(e), e.hash) < 0;
+      }), entryList_.end());
+  computeCounts();
+}
+
+// Add the entries and counts of other, which was built with the same args.
+void Dictionary::merge(const Dictionary& other) {
+  ntokens_ += other.ntokens_;
+  for (const auto& e : other.entryList_) {
+    auto s = other.symbol(e);
+    int32_t pos = find(s, e.hash);
+    if (table_[pos].id == -1) {
+      entryList_.push_back(e);
+      entryList_.back().offset = addSymbol(s);
+      table_[pos] = slot{e.hash, size_++};
+      if (entryList_.size() * 4 > table_.size() * 3) {
+        rebuildTable();
+      }
+    } else {
+      entryList_[table_[pos].id].count += e.count;
+    }
+  }
+}
+
 void Dictionary::computeCounts() {
   size_ = 0;
   nwords_ = 0;
   nlabels_ = 0;
-  std::fill(hashToIndex_.begin(), hashToIndex_.end(), -1);
   for (auto it = entryList_.begin(); it != entryList_.end(); ++it) {
-    int32_t h = find(it->symbol);
-    hashToIndex_[h] = size_++;
+    size_++;
     if (it->type == entry_type::word) nwords_++;
     if (it->type == entry_type::label) nlabels_++;
   }
+  compactSymbols();
+  rebuildTable();
+}
+
+void Dictionary::prune(
+    const vector<int32_t>& words,
+    const vector<int64_t>& buckets) {
+  vector<entry> entries;
+  entries.reserve(words.size() + nlabels_);
+  for (auto w : words) {
+    assert(w >= 0 && w < nwords_);
+    entries.push_back(entryList_[w]);
+  }
+  for (int32_t i = nwords_; i < size_; i++) {
+    entries.push_back(entryList_[i]);
+  }
+  entryList_.swap(entries);
+  computeCounts();
+
+  assert(std::is_sorted(buckets.begin(), buckets.end()));
+  pruneIdx_ = buckets;
+  pruneIdx_.shrink_to_fit();
+  pruneIdxSize_ = buckets.size();
+}
+
+int64_t Dictionary::nbuckets() const {
+  if (pruneIdxSize_ >= 0) {
+    return pruneIdxSize_;
+  }
+  return (args_->ngrams > 1) ? args_->bucket : 0;
 }
 
 // Given a model saved in .tsv format, build the dictionary from model.
 void Dictionary::loadDictFromModel(const string& modelfile) {
   cout << "Loading dict from model file : " << modelfile << endl;
-  ifstream fin(modelfile);
-  string line;
-  while (getline(fin, line)) {
-    string symbol;
-    stringstream ss(line);
-    ss >> symbol;
+  MappedFile file(modelfile);
+  if (!file.good()) {
+    cerr << "Model file cannot be opened for loading!" << endl;
+    exit(EXIT_FAILURE);
+  }
+  // The symbol is the first whitespace separated field of every line.
+  const char* p = file.data();
+  const char* end = file.data() + file.size();
+  string symbol;
+  while (p < end) {
+    auto nl = (const char*)memchr(p, '\n', end - p);
+    const char* lineEnd = (nl == nullptr) ? end : nl;
+    while (p < lineEnd && isspace(*p)) p++;
+    const char* symbolEnd = p;
+    while (symbolEnd < lineEnd && !isspace(*symbolEnd)) symbolEnd++;
+    symbol.assign(p, symbolEnd);
     insert(symbol);
+    p = lineEnd + 1;
   }
-  fin.close();
   computeCounts();
 
   std::cout << "Number of words in dictionary:  " << nwords_ << std::endl;
@@ -13,6 +13,7 @@
 #pragma once
 
 #include "utils/args.h"
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -21,20 +22,20 @@
 #include <memory>
 #include <boost/format.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
-
-#ifdef COMPRESS_FILE
-  #include <boost/iostreams/filter/zlib.hpp>
-  #include <boost/iostreams/filter/gzip.hpp>
-#endif
+#include <boost/utility/string_view.hpp>
 
 namespace starspace {
 
 class DataParser;
+struct ParseResults;
 
 enum class entry_type : int8_t {word=0, label=1};
 
+// The symbol of an entry is stored in the arena of its dictionary.
 struct entry {
-  std::string symbol;
+  uint64_t offset;
+  uint32_t length;
+  uint32_t hash;
   int64_t count;
   entry_type type;
 };
@@ -49,28 +50,93 @@ class Dictionary {
     int32_t nwords() const { return nwords_; };
     int32_t nlabels() const { return nlabels_; };
     int32_t ntokens() const { return ntokens_; };
-    int32_t getId(const std::string&) const;
+    int32_t getId(boost::string_view) const;
+    // Same, with the symbol's hash already computed.
+    int32_t getId(boost::string_view, uint32_t h) const;
     entry_type getType(int32_t) const;
-    entry_type getType(const std::string&) const;
-    const std::string& getSymbol(int32_t) const;
-    const std::string& getLabel(int32_t) const;
-
-    uint32_t hash(const std::string& str) const;
-    void insert(const std::string&);
+    entry_type getType(boost::string_view) const;
+    // Views into the dictionary, valid until it is next modified.
+    boost::string_view getSymbol(int32_t) const;
+    boost::string_view getLabel(int32_t) const;
+    int64_t getCount(int32_t id) const { return entryList_[id].count; }
+
+    static uint32_t hash(boost::string_view str);
+    // Count one occurrence of a symbol; returns its id. The symbol is only
+    // copied the first time it is seen.
+    int32_t insert(boost::string_view);
+    int32_t insert(boost::string_view, uint32_t h);
 
     void load(std::istream&);
     void save(std::ostream&) const;
-    void readFromFile(const std::string&, std::shared_ptr<DataParser>);
+    // Same content as save / load, plus the built hash table, so that
+    // loading needs neither hashing nor probing. Symbols are stored as one
+    // contiguous block of NUL-terminated strings.
+    // The bucket remap of pruned dictionaries follows the hash table;
+    // pass withPruning = false for files written before it was added.
+    void loadBinary(std::istream&, bool withPruning = true);
+    void saveBinary(std::ostream&) const;
+    // If corpora is given, the file is also parsed into examples while it
+    // is read, one corpus per reading thread, so that it is only read once.
+    void readFromFile(
+        const std::string&,
+        std::shared_ptr<DataParser>,
+        std::vector<std::vector<ParseResults>>* corpora = nullptr);
     bool readWord(std::istream&, std::string&) const;
+    // Number of symbols readFromFile keeps before raising the thresholds;
+    // 75% of MAX_VOCAB_SIZE by default.
+    void setVocabLimit(int64_t limit) { vocabLimit_ = limit; }
 
     void threshold(int64_t, int64_t);
+    // Recount the words and labels of entryList_, and rebuild the arena and
+    // the hash table for its entries.
     void computeCounts();
+    // Bytes held by the entries, the arena and the hash table.
+    size_t memoryUsage() const;
     void loadDictFromModel(const std::string& model);
 
+    // Keep only the given words (ids in increasing order) and the labels,
+    // and remap the given ngram buckets (in increasing order) to consecutive
+    // ngram rows. Buckets that are not listed are dropped.
+    void prune(const std::vector<int32_t>& words,
+               const std::vector<int64_t>& buckets);
+    bool isPruned() const { return pruneIdxSize_ >= 0; }
+    // Number of ngram rows of the model.
+    int64_t nbuckets() const;
+    // Ngram row of a hashed bucket, or -1 if the bucket has been pruned.
+    int64_t ngramIndex(int64_t bucket) const {
+      if (pruneIdxSize_ < 0) {
+        return bucket;
+      }
+      auto it = std::lower_bound(pruneIdx_.begin(), pruneIdx_.end(), bucket);
+      return (it == pruneIdx_.end() || *it != bucket) ?
+        -1 : it - pruneIdx_.begin();
+    }
+
   private:
     static const int32_t MAX_VOCAB_SIZE = 30000000;
-
-    int32_t find(const std::string&) const;
+    static const size_t MIN_TABLE_SIZE = 1024;
+
+    // A slot of the open addressing table: the full hash of the symbol,
+    // compared before the symbol itself, and its index in entryList_.
+    struct slot {
+      uint32_t hash;
+      int32_t id;
+    };
+
+    boost::string_view symbol(const entry& e) const {
+      return boost::string_view(symbols_.data() + e.offset, e.length);
+    }
+    // Copy a symbol to the end of the arena; returns its offset.
+    uint64_t addSymbol(boost::string_view);
+    // Keep only the symbols of entryList_ in the arena, in its order.
+    void compactSymbols();
+
+    int32_t find(boost::string_view) const;
+    int32_t find(boost::string_view, uint32_t h) const;
+    void rebuildTable();
+    void merge(const Dictionary& other);
+    void retain(const Dictionary& kept);
+    void evict(int64_t keep);
 
     void addNgrams(
         std::vector<int32_t>& line,
@@ -79,12 +145,24 @@ class Dictionary {
 
     std::shared_ptr<Args> args_;
     std::vector<entry> entryList_;
-    std::vector<int32_t> hashToIndex_;
+    // Arena of the symbols of entryList_, in its order, each followed by a
+    // NUL.
+    std::string symbols_;
+    // Power of two sized, kept at most 3/4 full.
+    std::vector<slot> table_;
 
     int32_t size_;
     int32_t nwords_;
     int32_t nlabels_;
     int64_t ntokens_;
+    // Largest count of a word dropped by evict().
+    int64_t evictedCount_;
+    int64_t vocabLimit_;
+
+    // Kept buckets in increasing order, the ngram row of each being its
+    // index; pruneIdxSize_ is -1 until pruned.
+    int64_t pruneIdxSize_;
+    std::vector<int64_t> pruneIdx_;
 };
 
 }
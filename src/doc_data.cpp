@@ -10,9 +10,9 @@
 #include "utils/utils.h"
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <assert.h>
-#include <numeric>
 #include <stdlib.h>
 
 using namespace std;
@@ -27,16 +27,20 @@ void LayerDataHandler::loadFromFile(
   const string& fileName,
   shared_ptr<DataParser> parser) {
 
-  vector<Corpus> corpora(args_->thread);
+  // One corpus per thread id, merged into examples_ at the end.
+  const int numThreads = std::max(args_->thread, 1);
+  vector<Corpus> corpora(numThreads);
+  vector<ParseResults> scratch(numThreads);
   if (args_->compressFile == "gzip") {
     foreach_line_gz(
       fileName,
       args_->numGzFile,
-      [&](std::string& line) {
-        auto& corpus = corpora[getThreadID()];
-        ParseResults example;
+      [&](boost::string_view line) {
+        auto& example = scratch[getThreadID()];
+        example.clear();
         if (parser->parse(line, example)) {
-          corpus.push_back(example);
+          // A copy allocates every vector at its exact size.
+          corpora[getThreadID()].push_back(example);
         }
       },
       args_->thread
@@ -52,41 +56,30 @@ void LayerDataHandler::loadFromFile(
     cout << "Loading data from file : " << fileName << endl;
     foreach_line(
       fileName,
-      [&](std::string& line) {
-        auto& corpus = corpora[getThreadID()];
-        ParseResults example;
+      [&](boost::string_view line) {
+        auto& example = scratch[getThreadID()];
+        example.clear();
         if (parser->parse(line, example)) {
-          corpus.push_back(example);
+          // A copy allocates every vector at its exact size.
+          corpora[getThreadID()].push_back(example);
         }
       },
       args_->thread
     );
   }
 
-  // Glue corpora together.
-  auto totalSize = std::accumulate(corpora.begin(), corpora.end(), size_t(0),
-                     [](size_t l, Corpus& r) { return l + r.size(); });
-  size_t destCursor = examples_.size();
-  examples_.resize(totalSize + examples_.size());
-  for (const auto &subcorp: corpora) {
-    std::copy(subcorp.begin(), subcorp.end(), examples_.begin() + destCursor);
-    destCursor += subcorp.size();
-  }
-  cout << "Total number of examples loaded : " << examples_.size() << endl;
-  size_ = examples_.size();
-  if (size_ == 0) {
-    errorOnZeroExample(fileName);
-  }
+  addCorpora(corpora, fileName);
 }
 
 void LayerDataHandler::insert(
     vector<Base>& rslt,
-    const vector<Base>& ex,
+    const Base* begin,
+    const Base* end,
     float dropout) const {
 
   if (dropout < 1e-8) {
     // if dropout is not enabled, copy all elements
-    rslt.insert(rslt.end(), ex.begin(), ex.end());
+    rslt.insert(rslt.end(), begin, end);
   } else {
     // dropout enabled
     auto rnd = [&] {
@@ -106,10 +99,10 @@ void LayerDataHandler::insert(
         rand_r(&rState);
 #endif
     };
-    for (const auto& it : ex) {
+    for (auto it = begin; it != end; it++) {
       auto p = (double)(rnd()) / RAND_MAX;
       if (p > dropout) {
-        rslt.push_back(it);
+        rslt.push_back(*it);
       }
     }
   }
@@ -185,31 +178,17 @@ void LayerDataHandler::convert(
   }
 }
 
-// generate a random word from examples
-Base LayerDataHandler::genRandomWord() const {
-  assert(size_ > 0);
-  auto& ex = examples_[rand() % size_];
-  int r = rand() % ex.RHSFeatures.size();
-  int wid = rand() % ex.RHSFeatures[r].size();
-  return ex.RHSFeatures[r][wid];
-}
-
 void LayerDataHandler::getRandomRHS(vector<Base>& result) const {
-  assert(size_ > 0);
-  auto& ex = examples_[rand() % size_];
-  unsigned int r = rand() % ex.RHSFeatures.size();
-
-  result.clear();
-  if (args_->trainMode == 2) {
-    // pick one random, the rest is rhs features
-    for (unsigned int i = 0; i < ex.RHSFeatures.size(); i++) {
-      if (i != r) {
-        insert(result, ex.RHSFeatures[i], args_->dropoutRHS);
-      }
-    }
-  } else {
-    insert(result, ex.RHSFeatures[r], args_->dropoutRHS);
+  assert(!rhsNegatives_.empty());
+  const int32_t i = rhsNegatives_.sample();
+  if (args_->dropoutRHS < 1e-8) {
+    getRHSCandidate(i, result);
+    return;
   }
+  vector<Base> candidate;
+  getRHSCandidate(i, candidate);
+  result.clear();
+  insert(result, candidate, args_->dropoutRHS);
 }
 
 void LayerDataHandler::save(ostream& out) {
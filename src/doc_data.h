@@ -38,12 +38,28 @@ public:
 
   void save(std::ostream& out) override;
 
-private:
-  Base genRandomWord() const override;
+protected:
+  // RHS candidates are made of the documents of an example.
+  size_t numRHSParts(const ParseResults& example) const override {
+    return example.RHSFeatures.size();
+  }
+  TokenRange getRHSPart(const ParseResults& example, size_t i)
+    const override {
+    const auto& doc = example.RHSFeatures[i];
+    return TokenRange(doc.data(), doc.data() + doc.size());
+  }
 
+private:
   void insert(
       std::vector<Base>& rslt,
       const std::vector<Base>& ex,
+      float dropout = 0.0) const {
+    insert(rslt, ex.data(), ex.data() + ex.size(), dropout);
+  }
+  void insert(
+      std::vector<Base>& rslt,
+      const Base* begin,
+      const Base* end,
       float dropout = 0.0) const;
 
 };
@@ -7,12 +7,11 @@
 
 #include "doc_parser.h"
 #include "utils/normalize.h"
+#include "utils/utils.h"
 #include <string>
 #include <vector>
 #include <fstream>
 
-#include <boost/algorithm/string.hpp>
-
 using namespace std;
 
 namespace starspace {
@@ -23,68 +22,77 @@ LayerDataParser::LayerDataParser(
 : DataParser(dict, args) {};
 
 bool LayerDataParser::parse(
-    string& s,
+    boost::string_view s,
+    vector<Base>& feats,
+    const string& sep) {
+  return parseFeatures(s, feats, sep);
+}
+
+bool LayerDataParser::parseFeatures(
+    boost::string_view s,
     vector<Base>& feats,
     const string& sep) {
 
   // split each part into tokens
-  vector<string> tokens;
-  boost::split(tokens, s, boost::is_any_of(string(sep)));
+  static thread_local vector<boost::string_view> tokens;
+  split_tokens(s, sep, tokens);
+
+  // Every token, the example weight included, takes part in the ngrams.
+  static thread_local vector<int32_t> wordHashes;
+  static thread_local vector<uint32_t> tokenHashes;
+  wordHashes.clear();
+  tokenHashes.resize(tokens.size());
+  for (size_t i = 0; i < tokens.size(); i++) {
+    hashToken(*dict_, tokens[i], tokenHashes[i], wordHashes);
+  }
 
   int start_idx = 0;
   float ex_weight = 1.0;
-  if (tokens[0].find("__weight__") != std::string::npos) {
+  if (tokens[0].find("__weight__") != boost::string_view::npos) {
     std::size_t pos = tokens[0].find(args_->weightSep);
-    if (pos != std::string::npos) {
-        ex_weight = atof(tokens[0].substr(pos + 1).c_str());
+    if (pos != boost::string_view::npos) {
+      ex_weight = parse_float(tokens[0].data() + pos + 1,
+                              tokens[0].data() + tokens[0].size());
     }
     start_idx = 1;
   }
 
+  string scratch;
   for (unsigned int i = start_idx; i < tokens.size(); i++) {
-    string t = tokens[i];
-    float weight = 1.0;
-    if (args_->useWeight) {
-      std::size_t pos = tokens[i].find(args_->weightSep);
-      if (pos != std::string::npos) {
-        t = tokens[i].substr(0, pos);
-        weight = atof(tokens[i].substr(pos + 1).c_str());
-      }
-    }
-
-    if (args_->normalizeText) {
-      normalize_text(t);
-    }
-    int32_t wid = dict_->getId(t);
+    boost::string_view symbol;
+    float weight;
+    uint32_t h = tokenHashes[i];
+    parseToken(tokens[i], symbol, weight, scratch, &h);
+    int32_t wid = dict_->getId(symbol, h);
     if (wid != -1)  {
       feats.push_back(make_pair(wid, weight * ex_weight));
     }
   }
 
   if (args_->ngrams > 1) {
-    addNgrams(tokens, feats, args_->ngrams);
+    addNgrams(wordHashes, feats, args_->ngrams);
   }
 
   return feats.size() > 0;
 }
 
 bool LayerDataParser::parse(
-    string& line,
+    boost::string_view line,
     ParseResults& rslt,
     const string& sep) {
 
-  vector<string> parts;
-  boost::split(parts, line, boost::is_any_of("\t"));
+  static thread_local vector<boost::string_view> parts;
+  split_tokens(line, "\t", parts);
   int start_idx = 0;
 
   if (args_->trainMode == 0) {
     // the first part is input features
-    parse(parts[start_idx], rslt.LHSTokens);
+    parseFeatures(parts[start_idx], rslt.LHSTokens);
     start_idx += 1;
   }
   for (unsigned int i = start_idx; i < parts.size(); i++) {
     vector<Base> feats;
-    if (parse(parts[i], feats)) {
+    if (parseFeatures(parts[i], feats)) {
       rslt.RHSFeatures.push_back(feats);
     }
   }
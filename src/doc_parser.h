@@ -27,15 +27,20 @@ public:
     std::shared_ptr<Args> args);
 
   bool parse(
-      std::string& line,
+      boost::string_view line,
       std::vector<Base>& rslt,
       const std::string& sep=" ");
 
   bool parse(
-      std::string& line,
+      boost::string_view line,
       ParseResults& rslt,
       const std::string& sep="\t") override;
 
+private:
+  bool parseFeatures(
+      boost::string_view s,
+      std::vector<Base>& rslt,
+      const std::string& sep=" ");
 };
 
 }
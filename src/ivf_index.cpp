@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ivf_index.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <utility>
+
+namespace starspace {
+
+using namespace std;
+
+namespace {
+
+const int kIterations = 8;
+// k-means is trained on at most this many vectors per centroid.
+const size_t kSamplesPerList = 64;
+
+inline float dot(const float* a, const float* b, size_t n) {
+  float s = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    s += a[i] * b[i];
+  }
+  return s;
+}
+
+}
+
+IVFIndex::IVFIndex(
+    vector<float> vectors, size_t dim, size_t nlist, unsigned seed)
+  : dim_(dim) {
+  assert(dim > 0 && vectors.size() % dim == 0);
+  const size_t n = vectors.size() / dim;
+  nlist = (std::max)(size_t(1), (std::min)(nlist, n));
+  minstd_rand rng(seed);
+
+  // Centroids start from random vectors of the sample.
+  vector<size_t> sample(n);
+  iota(sample.begin(), sample.end(), 0);
+  shuffle(sample.begin(), sample.end(), rng);
+  sample.resize((std::min)(n, nlist * kSamplesPerList));
+  centroids_.resize(nlist * dim);
+  halfNorms_.resize(nlist);
+  auto setCentroid = [&](size_t c, const float* v) {
+    copy(v, v + dim, centroids_.begin() + c * dim);
+    halfNorms_[c] = 0.5 * dot(v, v, dim);
+  };
+  for (size_t c = 0; c < nlist; c++) {
+    setCentroid(c, &vectors[sample[c] * dim]);
+  }
+
+  // Lloyd iterations on the sample; an empty cluster restarts from a
+  // random vector.
+  vector<double> sums(nlist * dim);
+  vector<size_t> counts(nlist);
+  for (int it = 0; it < kIterations && nlist > 1; it++) {
+    fill(sums.begin(), sums.end(), 0.0);
+    fill(counts.begin(), counts.end(), 0);
+    for (auto i : sample) {
+      const float* v = &vectors[i * dim];
+      size_t c = nearestCentroid(v);
+      counts[c]++;
+      for (size_t j = 0; j < dim; j++) {
+        sums[c * dim + j] += v[j];
+      }
+    }
+    for (size_t c = 0; c < nlist; c++) {
+      if (counts[c] == 0) {
+        setCentroid(c, &vectors[sample[rng() % sample.size()] * dim]);
+        continue;
+      }
+      for (size_t j = 0; j < dim; j++) {
+        centroids_[c * dim + j] = sums[c * dim + j] / counts[c];
+      }
+      const float* centroid = &centroids_[c * dim];
+      halfNorms_[c] = 0.5 * dot(centroid, centroid, dim);
+    }
+  }
+
+  // Store every vector in the list of its centroid.
+  vector<size_t> lists(n);
+  listOffsets_.assign(nlist + 1, 0);
+  for (size_t i = 0; i < n; i++) {
+    lists[i] = nearestCentroid(&vectors[i * dim]);
+    listOffsets_[lists[i] + 1]++;
+  }
+  partial_sum(listOffsets_.begin(), listOffsets_.end(), listOffsets_.begin());
+  vector<size_t> pos(listOffsets_.begin(), listOffsets_.end() - 1);
+  vectors_.resize(n * dim);
+  ids_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    size_t p = pos[lists[i]]++;
+    ids_[p] = i;
+    copy(&vectors[i * dim], &vectors[i * dim] + dim, &vectors_[p * dim]);
+  }
+}
+
+// Larger for closer centroids: ordering centroids by it is ordering them
+// by squared distance to v, which is |v|^2 - 2 * score.
+float IVFIndex::centroidScore(const float* v, size_t c) const {
+  return dot(v, &centroids_[c * dim_], dim_) - halfNorms_[c];
+}
+
+size_t IVFIndex::nearestCentroid(const float* v) const {
+  size_t best = 0;
+  float bestScore = centroidScore(v, 0);
+  for (size_t c = 1; c < halfNorms_.size(); c++) {
+    float score = centroidScore(v, c);
+    if (score > bestScore) {
+      best = c;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+void IVFIndex::search(
+    const float* query, size_t k, size_t nprobe, vector<int32_t>& ids) const {
+  ids.clear();
+  if (k == 0) {
+    return;
+  }
+  vector<pair<float, size_t>> lists(numLists());
+  for (size_t c = 0; c < lists.size(); c++) {
+    lists[c] = { centroidScore(query, c), c };
+  }
+  nprobe = (std::min)(nprobe, lists.size());
+  partial_sort(lists.begin(), lists.begin() + nprobe, lists.end(),
+               greater<pair<float, size_t>>());
+
+  // The best k so far, in a min-heap.
+  vector<pair<float, int32_t>> best;
+  auto worse = greater<pair<float, int32_t>>();
+  for (size_t l = 0; l < nprobe; l++) {
+    size_t c = lists[l].second;
+    for (size_t p = listOffsets_[c]; p < listOffsets_[c + 1]; p++) {
+      float score = dot(query, &vectors_[p * dim_], dim_);
+      if (best.size() < k) {
+        best.emplace_back(score, ids_[p]);
+        push_heap(best.begin(), best.end(), worse);
+      } else if (score > best.front().first) {
+        pop_heap(best.begin(), best.end(), worse);
+        best.back() = { score, ids_[p] };
+        push_heap(best.begin(), best.end(), worse);
+      }
+    }
+  }
+  sort_heap(best.begin(), best.end(), worse);
+  for (const auto& b : best) {
+    ids.push_back(b.second);
+  }
+}
+
+}
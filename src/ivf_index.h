@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// IVFIndex finds vectors of large inner product with a query without
+// scanning all of them. It is used to mine hard negatives in training.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace starspace {
+
+/*
+ * An inverted file index: the vectors are clustered around nlist
+ * centroids by a few rounds of k-means on a sample of them, and stored
+ * list by list. A query only scans the lists of the nprobe centroids
+ * closest to it, so results are approximate.
+ */
+class IVFIndex {
+public:
+  // vectors holds n vectors of dim values one after the other.
+  IVFIndex(std::vector<float> vectors, size_t dim, size_t nlist,
+           unsigned seed = 0);
+
+  size_t size() const { return ids_.size(); }
+  size_t numLists() const { return listOffsets_.size() - 1; }
+
+  // Replace ids by the k vectors of largest inner product with query
+  // among the lists of the nprobe closest centroids, best first.
+  void search(const float* query, size_t k, size_t nprobe,
+              std::vector<int32_t>& ids) const;
+
+private:
+  // Index of the centroid closest to v.
+  size_t nearestCentroid(const float* v) const;
+  float centroidScore(const float* v, size_t c) const;
+
+  size_t dim_;
+  std::vector<float> centroids_;
+  // Half the squared norm of every centroid.
+  std::vector<float> halfNorms_;
+  // The vectors and their ids in list order; list l spans listOffsets_[l]
+  // to listOffsets_[l + 1].
+  std::vector<float> vectors_;
+  std::vector<int32_t> ids_;
+  std::vector<size_t> listOffsets_;
+};
+
+}
@@ -31,8 +31,32 @@ int main(int argc, char** argv) {
       sp.init();
     }
     sp.train();
+    sp.prune();
     sp.saveModel(args->model);
     sp.saveModelTsv(args->model + ".tsv");
+  } else if (args->isQuantize) {
+    if (boost::algorithm::ends_with(args->model, ".tsv")) {
+      sp.initFromTsv(args->model);
+    } else {
+      sp.initFromSavedModel(args->model);
+    }
+    Metrics before, after;
+    if (!args->testFile.empty()) {
+      cout << "------Evaluating the original model:\n";
+      before = sp.evaluate();
+    }
+    sp.quantize();
+    if (!args->testFile.empty()) {
+      cout << "------Evaluating the quantized model:\n";
+      after = sp.evaluate();
+      cout << "Change after quantization : "
+           << "hit@1: " << after.hit1 - before.hit1
+           << " hit@10: " << after.hit10 - before.hit10
+           << " hit@20: " << after.hit20 - before.hit20
+           << " hit@50: " << after.hit50 - before.hit50
+           << " mean ranks : " << after.rank - before.rank << endl;
+    }
+    sp.saveModel(args->model + ".q");
   } else {
     if (boost::algorithm::ends_with(args->model, ".tsv")) {
       sp.initFromTsv(args->model);
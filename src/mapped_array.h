@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * MappedArray is the storage behind our ublas matrices. By default it
+ * behaves like ublas::unbounded_array and owns heap memory, but it can
+ * also be pointed at a region of a memory-mapped file, so that a lookup
+ * table much larger than RAM is paged in row by row as it is used.
+ *
+ * Copies always own their memory. Resizing to the current size keeps the
+ * mapping; resizing to any other size drops it.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+#include <boost/numeric/ublas/storage.hpp>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace starspace {
+
+template<class T>
+class MappedArray :
+  public boost::numeric::ublas::storage_array<MappedArray<T>> {
+public:
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef T value_type;
+  typedef const T& const_reference;
+  typedef T& reference;
+  typedef const T* const_pointer;
+  typedef T* pointer;
+  typedef const_pointer const_iterator;
+  typedef pointer iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+
+  MappedArray() : size_(0), data_(nullptr), map_(nullptr), mapLen_(0) {}
+
+  explicit MappedArray(size_type size)
+  : size_(0), data_(nullptr), map_(nullptr), mapLen_(0) {
+    allocate(size);
+  }
+
+  MappedArray(size_type size, const value_type& init)
+  : size_(0), data_(nullptr), map_(nullptr), mapLen_(0) {
+    allocate(size);
+    std::fill(begin(), end(), init);
+  }
+
+  MappedArray(const MappedArray& c)
+  : boost::numeric::ublas::storage_array<MappedArray<T>>(),
+    size_(0), data_(nullptr), map_(nullptr), mapLen_(0) {
+    allocate(c.size_);
+    std::copy(c.begin(), c.end(), begin());
+  }
+
+  MappedArray(MappedArray&& c)
+  : size_(c.size_), data_(c.data_), map_(c.map_), mapLen_(c.mapLen_) {
+    c.size_ = 0;
+    c.data_ = nullptr;
+    c.map_ = nullptr;
+    c.mapLen_ = 0;
+  }
+
+  ~MappedArray() { release(); }
+
+  MappedArray& operator=(const MappedArray& a) {
+    if (this != &a) {
+      resize(a.size_);
+      std::copy(a.begin(), a.end(), begin());
+    }
+    return *this;
+  }
+
+  MappedArray& operator=(MappedArray&& a) {
+    swap(a);
+    return *this;
+  }
+
+  MappedArray& assign_temporary(MappedArray& a) {
+    swap(a);
+    return *this;
+  }
+
+  void resize(size_type size) {
+    if (size != size_) {
+      release();
+      allocate(size);
+    }
+  }
+
+  // Keeps the first elements and fills the new ones with init.
+  void resize(size_type size, value_type init) {
+    if (size == size_) {
+      return;
+    }
+    MappedArray tmp(size, init);
+    std::copy(begin(), begin() + (std::min)(size, size_), tmp.begin());
+    swap(tmp);
+  }
+
+  void swap(MappedArray& a) {
+    if (this != &a) {
+      std::swap(size_, a.size_);
+      std::swap(data_, a.data_);
+      std::swap(map_, a.map_);
+      std::swap(mapLen_, a.mapLen_);
+    }
+  }
+
+  friend void swap(MappedArray& a1, MappedArray& a2) { a1.swap(a2); }
+
+  size_type size() const { return size_; }
+  size_type max_size() const { return size_type(-1) / sizeof(T); }
+  bool empty() const { return size_ == 0; }
+
+  const_reference operator[](size_type i) const { return data_[i]; }
+  reference operator[](size_type i) { return data_[i]; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator cbegin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  const_iterator cend() const { return data_ + size_; }
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+
+  bool isMapped() const { return map_ != nullptr; }
+
+  // Refer to size elements stored at byte offset of the open file fd.
+  // Writable mappings are private (copy on write) unless shared is set, in
+  // which case updates are written back to the file, and fd must be open
+  // for writing. Returns false, leaving the array unchanged, if mapping
+  // fails.
+  bool map(int fd, uint64_t offset, size_type size, bool writable,
+           bool shared = false) {
+#ifdef _WIN32
+    return false;
+#else
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    const uint64_t start = offset - offset % page;
+    const size_t len = (offset - start) + size * sizeof(T);
+    void* p = mmap(nullptr, len,
+                   writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                   writable && shared ? MAP_SHARED : MAP_PRIVATE,
+                   fd, start);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    release();
+    map_ = p;
+    mapLen_ = len;
+    size_ = size;
+    data_ = (T*)((char*)p + (offset - start));
+    return true;
+#endif
+  }
+
+  // madvise the pages holding elements [begin, end).
+  void advise(size_type begin, size_type end, int advice) {
+#ifndef _WIN32
+    if (isMapped() && begin < end) {
+      char* b;
+      size_t len;
+      pageRange(begin, end, b, len);
+      madvise(b, len, advice);
+    }
+#endif
+  }
+
+  // Keep the pages holding elements [begin, end) resident.
+  bool lock(size_type begin, size_type end) {
+#ifdef _WIN32
+    return false;
+#else
+    if (!isMapped() || begin >= end) {
+      return true;
+    }
+    char* b;
+    size_t len;
+    pageRange(begin, end, b, len);
+    return mlock(b, len) == 0;
+#endif
+  }
+
+  // Flush a shared writable mapping to its file.
+  bool sync() {
+#ifdef _WIN32
+    return false;
+#else
+    return !isMapped() || msync(map_, mapLen_, MS_SYNC) == 0;
+#endif
+  }
+
+private:
+  void allocate(size_type size) {
+    size_ = size;
+    data_ = size ? new T[size] : nullptr;
+  }
+
+  void release() {
+#ifndef _WIN32
+    if (map_ != nullptr) {
+      munmap(map_, mapLen_);
+      map_ = nullptr;
+      mapLen_ = 0;
+      data_ = nullptr;
+    }
+#endif
+    delete[] data_;
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+#ifndef _WIN32
+  void pageRange(size_type begin, size_type end, char*& b, size_t& len) {
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t lo = uintptr_t(data_ + begin);
+    uintptr_t hi = uintptr_t(data_ + end);
+    lo -= lo % page;
+    b = (char*)lo;
+    len = hi - lo;
+  }
+#endif
+
+  size_type size_;
+  T* data_;
+  void* map_;
+  size_t mapLen_;
+};
+
+}
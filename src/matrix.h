@@ -24,6 +24,8 @@
 #include <boost/numeric/ublas/matrix_proxy.hpp>
 #include <boost/numeric/ublas/io.hpp>
 
+#include "mapped_array.h"
+
 namespace starspace {
 
 struct MatrixDims {
@@ -37,7 +39,10 @@ struct MatrixDims {
 template<typename Real = float>
 struct Matrix {
   static const int kAlign = 64;
-  boost::numeric::ublas::matrix<Real> matrix;
+  // Dense row-major storage that may also be backed by a mapped file.
+  typedef boost::numeric::ublas::matrix<
+    Real, boost::numeric::ublas::row_major, MappedArray<Real>> UblasMatrix;
+  UblasMatrix matrix;
 
   explicit Matrix(MatrixDims dims,
                   Real sd = 1.0) :
@@ -160,8 +165,7 @@ struct Matrix {
     row(r) += Row { addend.matrix, 0 } * scale;
   }
 
-  typedef boost::numeric::ublas::matrix_row<boost::numeric::ublas::matrix<Real>>
-     Row;
+  typedef boost::numeric::ublas::matrix_row<UblasMatrix> Row;
   Row row(size_t r) { return Row{ matrix, r }; }
 
   /* implicit */ operator Row() {
@@ -202,7 +206,7 @@ struct Matrix {
 
   private:
   void alloc(size_t r, size_t c) {
-    matrix = boost::numeric::ublas::matrix<Real>(r, c);
+    matrix = UblasMatrix(r, c);
   }
 };
 
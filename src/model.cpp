@@ -12,15 +12,19 @@
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
 
 #include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <numeric>
+#include <cstring>
+#include <cstdio>
 
 
 #ifdef _WIN32
@@ -32,6 +36,11 @@
 #include <unistd.h>
 #endif
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
 int getNumberOfCores() {
 #ifdef WIN32
   SYSTEM_INFO sysinfo;
@@ -63,25 +72,28 @@ using namespace boost::numeric;
 
 EmbedModel::EmbedModel(
     shared_ptr<Args> args,
-    shared_ptr<Dictionary> dict) {
+    shared_ptr<Dictionary> dict,
+    bool randomInit) {
 
   args_ = args;
   dict_ = dict;
 
-  initModelWeights();
+  initModelWeights(randomInit);
 }
 
-void EmbedModel::initModelWeights() {
+void EmbedModel::initModelWeights(bool randomInit) {
   assert(dict_ != nullptr);
-  size_t num_lhs = dict_->nwords() + dict_->nlabels();
-
-  if (args_->ngrams > 1) {
-    num_lhs += args_->bucket;
+  size_t num_lhs = dict_->nwords() + dict_->nlabels() + dict_->nbuckets();
+  // Tables that are about to be loaded are not allocated here, so that
+  // mapped models never need memory for their full size.
+  if (!randomInit) {
+    num_lhs = 0;
   }
 
+  Real sd = randomInit ? args_->initRandSd : 0.0;
   LHSEmbeddings_ =
     std::shared_ptr<SparseLinear<Real>>(
-      new SparseLinear<Real>({num_lhs, args_->dim},args_->initRandSd)
+      new SparseLinear<Real>({num_lhs, args_->dim}, sd)
     );
 
   if (args_->shareEmb) {
@@ -89,7 +101,7 @@ void EmbedModel::initModelWeights() {
   } else {
     RHSEmbeddings_ =
       std::shared_ptr<SparseLinear<Real>>(
-        new SparseLinear<Real>({num_lhs, args_->dim},args_->initRandSd)
+        new SparseLinear<Real>({num_lhs, args_->dim}, sd)
       );
   }
 
@@ -105,6 +117,21 @@ void EmbedModel::initModelWeights() {
   }
 }
 
+shared_ptr<EmbedModel> EmbedModel::snapshot() const {
+  auto retval = make_shared<EmbedModel>(args_, dict_, false);
+  retval->LHSEmbeddings_ = make_shared<SparseLinear<Real>>(*LHSEmbeddings_);
+  if (args_->shareEmb) {
+    retval->RHSEmbeddings_ = retval->LHSEmbeddings_;
+  } else {
+    retval->RHSEmbeddings_ = make_shared<SparseLinear<Real>>(*RHSEmbeddings_);
+  }
+  retval->LHSQuant_ = LHSQuant_;
+  retval->RHSQuant_ = RHSQuant_;
+  vector<Real>().swap(retval->LHSUpdates_);
+  vector<Real>().swap(retval->RHSUpdates_);
+  return retval;
+}
+
 Real dot(Matrix<Real>::Row a, Matrix<Real>::Row b) {
   assert(a.size() > 0);
   assert(a.size() == b.size());
@@ -140,7 +167,11 @@ Matrix<Real> EmbedModel::projectLHS(const std::vector<Base>& ws) {
 }
 
 void EmbedModel::projectLHS(const std::vector<Base>& ws, Matrix<Real>& retval) {
-  LHSEmbeddings_->forward(ws, retval);
+  if (LHSQuant_ != nullptr) {
+    LHSQuant_->forward(ws, retval);
+  } else {
+    LHSEmbeddings_->forward(ws, retval);
+  }
   if (ws.size()) {
     auto norm = (args_->similarity == "dot") ?
       pow(ws.size(), args_->p) : norm2(retval);
@@ -149,7 +180,11 @@ void EmbedModel::projectLHS(const std::vector<Base>& ws, Matrix<Real>& retval) {
 }
 
 void EmbedModel::projectRHS(const std::vector<Base>& ws, Matrix<Real>& retval) {
-  RHSEmbeddings_->forward(ws, retval);
+  if (RHSQuant_ != nullptr) {
+    RHSQuant_->forward(ws, retval);
+  } else {
+    RHSEmbeddings_->forward(ws, retval);
+  }
   if (ws.size()) {
     auto norm = (args_->similarity == "dot") ?
       pow(ws.size(), args_->p) : norm2(retval);
@@ -176,9 +211,17 @@ Real EmbedModel::train(shared_ptr<InternDataHandler> data,
   }
   std::random_shuffle(indices.begin(), indices.end());
 
-  // Compute word negatives
-  if (args_->trainMode == 5 || args_->trainWord) {
-    data->initWordNegatives();
+  // Cached norms go stale as soon as the embeddings are updated.
+  clearNormCache();
+
+  // Negatives are sampled from the dictionary and the examples, which do
+  // not change between epochs.
+  if ((args_->trainMode == 5 || args_->trainWord) &&
+      !data->hasWordNegatives()) {
+    data->initWordNegatives(*dict_);
+  }
+  if (args_->trainMode != 5 && !data->hasRHSNegatives()) {
+    data->initRHSNegatives();
   }
 
   // If we decrement after *every* sample, precision causes us to lose the
@@ -191,8 +234,11 @@ Real EmbedModel::train(shared_ptr<InternDataHandler> data,
   numThreads = (std::max)(numThreads, 2);
   numThreads -= 1; // Withold one thread for the norm thread.
   numThreads = (std::min)(numThreads, int(numSamples));
-  vector<Real> losses(numThreads);
-  vector<long> counts(numThreads);
+  std::atomic<long> batchesDone(0);
+  std::ofstream metrics;
+  TrainMonitor monitor(numThreads, numSamples, epochs_done, args_->epoch,
+                       t_start, args_->maxTrainTime);
+  monitor.setRate(rate);
 
   auto trainThread = [&](int idx,
                          vector<int>::const_iterator start,
@@ -200,16 +246,13 @@ Real EmbedModel::train(shared_ptr<InternDataHandler> data,
     assert(start >= indices.begin());
     assert(end >= start);
     assert(end <= indices.end());
-    bool amMaster = idx == 0;
-    auto t_epoch_start = std::chrono::high_resolution_clock::now();
-    losses[idx] = 0.0;
-    counts[idx] = 0;
 
     unsigned int batch_sz = args_->batchSize;
     vector<ParseResults> examples;
     for (auto ip = start; ip < end; ip++) {
       auto i = *ip;
       float thisLoss = 0.0;
+      monitor.addExample(idx);
       if (args_->trainMode == 5 || args_->trainWord) {
         vector<ParseResults> exs;
         data->getWordExamples(i, exs);
@@ -217,15 +260,15 @@ Real EmbedModel::train(shared_ptr<InternDataHandler> data,
         for (unsigned int i = 0; i < exs.size(); i++) {
           word_exs.push_back(exs[i]);
           if (word_exs.size() >= batch_sz || i == exs.size() - 1) {
+            BatchStats stats;
             if (args_->loss == "softmax") {
-              thisLoss = trainNLLBatch(data, word_exs, negSearchLimit, rate, true);
+              thisLoss = trainNLLBatch(data, word_exs, negSearchLimit, rate, true, &stats);
             } else {
-              thisLoss = trainOneBatch(data, word_exs, negSearchLimit, rate, true);
+              thisLoss = trainOneBatch(data, word_exs, negSearchLimit, rate, true, &stats);
             }
             word_exs.clear();
             assert(thisLoss >= 0.0);
-            counts[idx]++;
-            losses[idx] += thisLoss;
+            monitor.addBatch(idx, thisLoss, stats.violations, stats.updates);
           }
         }
       }
@@ -237,67 +280,78 @@ Real EmbedModel::train(shared_ptr<InternDataHandler> data,
         }
         examples.push_back(ex);
         if (examples.size() >= batch_sz || (ip + 1) == end) {
+          BatchStats stats;
           if (args_->loss == "softmax") {
-            thisLoss = trainNLLBatch(data, examples, negSearchLimit, rate, false);
+            thisLoss = trainNLLBatch(data, examples, negSearchLimit, rate, false, &stats);
           } else {
-            thisLoss = trainOneBatch(data, examples, negSearchLimit, rate, false);
+            thisLoss = trainOneBatch(data, examples, negSearchLimit, rate, false, &stats);
           }
           examples.clear();
+          batchesDone++;
 
           assert(thisLoss >= 0.0);
-          counts[idx]++;
-          losses[idx] += thisLoss;
+          monitor.addBatch(idx, thisLoss, stats.violations, stats.updates);
         }
       }
 
       // update rate racily.
       if ((i % kDecrStep) == (kDecrStep - 1)) {
         rate -= decrPerKSample;
+        monitor.setRate(rate);
       }
       auto t_end = std::chrono::high_resolution_clock::now();
       auto tot_spent = std::chrono::duration<double>(t_end-t_start).count();
       if (tot_spent > args_->maxTrainTime) {
         break;
       }
-      if (amMaster && ((ip - indices.begin()) % 100 == 99 || (ip + 1) == end)) {
-
-        auto t_epoch_spent =
-          std::chrono::duration<double>(t_end-t_epoch_start).count();
-        double ex_done_this_epoch = ip - indices.begin();
-        int ex_left = ((end - start) * (args_->epoch - epochs_done))
-                      - ex_done_this_epoch;
-        double ex_done = epochs_done * (end - start) + ex_done_this_epoch;
-        double time_per_ex = double(t_epoch_spent) / ex_done_this_epoch;
-        int eta = int(time_per_ex * double(ex_left));
-        double epoch_progress = ex_done_this_epoch / (end - start);
-        double progress = ex_done / (ex_done + ex_left);
-        if (eta > args_->maxTrainTime - tot_spent) {
-          eta = args_->maxTrainTime - tot_spent;
-          progress = tot_spent / (eta + tot_spent);
-        }
-        int etah = eta / 3600;
-        int etam = (eta - etah * 3600) / 60;
-        int toth = int(tot_spent) / 3600;
-        int totm = (tot_spent - toth * 3600) / 60;
-        int tots = (tot_spent - toth * 3600 - totm * 60);
-        std::cerr << std::fixed;
-        std::cerr << "\rEpoch: " << std::setprecision(1) << 100 * epoch_progress << "%";
-        std::cerr << "  lr: " << std::setprecision(6) << rate;
-        std::cerr << "  loss: " << std::setprecision(6) << losses[idx] / counts[idx];
-        if (eta < 60) {
-          std::cerr << "  eta: <1min ";
-        } else {
-          std::cerr << "  eta: " << std::setprecision(3) << etah << "h" << etam << "m";
-        }
-        std::cerr << "  tot: " << std::setprecision(3) << toth << "h" << totm << "m"  << tots << "s ";
-        std::cerr << " (" << std::setprecision(1) << 100 * progress << "%)";
-        std::cerr << std::flush;
-      }
     }
   };
 
+  // Progress goes to stderr and, with -metricsFile, to a JSON lines file
+  // which the epochs after the first append to.
+  if (verbose) {
+    if (!args_->metricsFile.empty()) {
+      metrics.open(args_->metricsFile,
+                   epochs_done > 0 ? std::ios::app : std::ios::trunc);
+      if (!metrics.is_open()) {
+        cerr << "Metrics file " << args_->metricsFile
+             << " cannot be opened for writing!\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+    monitor.start(args_->reportInterval, &std::cerr,
+                  metrics.is_open() ? &metrics : nullptr);
+  }
+
   vector<thread> threads;
-  bool doneTraining = false;
+  std::atomic<bool> doneTraining(false);
+
+  // Hard negatives are searched in an index of the RHS candidates, which a
+  // background thread rebuilds every hardNegRefresh batches from the
+  // embeddings being trained. Until the first one is built, negatives are
+  // all sampled. The validation loss (rate 0) only uses sampled ones.
+  std::mutex indexMutex;
+  std::condition_variable indexCv;
+  std::thread indexBuilder;
+  if (args_->hardNegatives > 0 && args_->trainMode != 5 &&
+      args_->loss == "hinge" && rate > 0.0) {
+    indexBuilder = std::thread([&] {
+      long builtAt = 0;
+      unsigned seed = 0;
+      std::unique_lock<std::mutex> lock(indexMutex);
+      while (!doneTraining) {
+        if (hardNegData_ != data.get() ||
+            batchesDone - builtAt >= args_->hardNegRefresh) {
+          builtAt = batchesDone;
+          lock.unlock();
+          buildHardNegIndex(*data, doneTraining, seed++);
+          lock.lock();
+        } else {
+          indexCv.wait_for(lock, std::chrono::milliseconds(20));
+        }
+      }
+    });
+  }
   size_t numPerThread = ceil(numSamples / numThreads);
   assert(numPerThread > 0);
   for (size_t i = 0; i < (size_t)numThreads; i++) {
@@ -331,13 +385,19 @@ Real EmbedModel::train(shared_ptr<InternDataHandler> data,
     }
   });
   for (auto& t: threads) t.join();
-  // All done. Shut the truncator down.
-  doneTraining = true;
+  // All done. Shut the truncator and the index builder down.
+  {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    doneTraining = true;
+  }
+  indexCv.notify_all();
   truncator.join();
+  if (indexBuilder.joinable()) {
+    indexBuilder.join();
+  }
 
-  Real totLoss = std::accumulate(losses.begin(), losses.end(), 0.0);
-  long totCount = std::accumulate(counts.begin(), counts.end(), 0);
-  return totLoss / totCount;
+  monitor.stop();
+  return monitor.meanLoss();
 }
 
 void EmbedModel::normalize(Matrix<float>::Row row, double maxNorm) {
@@ -354,7 +414,8 @@ float EmbedModel::trainOneBatch(shared_ptr<InternDataHandler> data,
                            const vector<ParseResults>& batch_exs,
                            size_t negSearchLimit,
                            Real rate0,
-                           bool trainWord) {
+                           bool trainWord,
+                           BatchStats* stats) {
 
   using namespace boost::numeric::ublas;
   // Keep all the activations on the stack so we can asynchronously
@@ -392,20 +453,16 @@ float EmbedModel::trainOneBatch(shared_ptr<InternDataHandler> data,
     return retval;
   };
 
-  // Get a random batch of negatives
-  std::vector<Matrix<Real>> rhsN(negSearchLimit);
+  // Get a batch of negatives.
+  std::vector<Matrix<Real>> rhsN;
   std::vector<std::vector<Base>> batch_negLabels;
-
-  for (unsigned int i = 0; i < negSearchLimit; i++) {
-    std::vector<Base> negLabels;
-    if (trainWord) {
-      data->getRandomWord(negLabels);
-    } else {
-      data->getRandomRHS(negLabels);
-    }
-    projectRHS(negLabels, rhsN[i]);;
-    check(rhsN[i]);
-    batch_negLabels.push_back(negLabels);
+  batchNegatives(*data, batch_exs, lhs, rhsP, negSearchLimit, rate0,
+                 trainWord, batch_negLabels, rhsN);
+  negSearchLimit = rhsN.size();
+  // In-batch negatives are scored with one matrix product.
+  Matrix<Real> negSims;
+  if (args_->inBatchNeg) {
+    projectedSimilarities(lhs, rhsN, negSims);
   }
 
   // Select negative examples
@@ -430,7 +487,9 @@ float EmbedModel::trainOneBatch(shared_ptr<InternDataHandler> data,
       if (batch_exs[i].RHSTokens == batch_negLabels[j]) {
         continue;
       }
-      auto thisLoss = tripleLoss(posSim[i], similarity(lhs[i], rhsN[j]));
+      auto negSim = args_->inBatchNeg ?
+        negSims.matrix(i, j) : similarity(lhs[i], rhsN[j]);
+      auto thisLoss = tripleLoss(posSim[i], negSim);
       if (thisLoss > 0.0) {
         num_negs[i]++;
         loss[i] += thisLoss;
@@ -457,6 +516,13 @@ float EmbedModel::trainOneBatch(shared_ptr<InternDataHandler> data,
     }
   }
 
+  if (stats != nullptr) {
+    for (auto n : num_negs) {
+      stats->violations += n;
+      stats->updates += (n > 0 && rate0 != 0.0);
+    }
+  }
+
   // Couldn't find a negative example given reasonable effort, so
   // give up.
   if (total_loss == 0.0) return 0.0;
@@ -484,6 +550,141 @@ float EmbedModel::trainOneBatch(shared_ptr<InternDataHandler> data,
   return total_loss;
 }
 
+void EmbedModel::batchNegatives(
+    const InternDataHandler& data,
+    const vector<ParseResults>& batch_exs,
+    const vector<Matrix<Real>>& lhs,
+    const vector<Matrix<Real>>& rhsP,
+    size_t negSearchLimit,
+    Real rate,
+    bool trainWord,
+    vector<vector<Base>>& negLabels,
+    vector<Matrix<Real>>& rhsN) {
+  negLabels.clear();
+  rhsN.clear();
+  // The positive of an example is skipped as its own negative, as is any
+  // negative with the same labels.
+  if (args_->inBatchNeg && batch_exs.size() > 1) {
+    for (size_t i = 0; i < batch_exs.size(); i++) {
+      negLabels.push_back(batch_exs[i].RHSTokens);
+      rhsN.push_back(rhsP[i]);
+    }
+  }
+  size_t numSampled = negSearchLimit - (std::min)(negSearchLimit, rhsN.size());
+
+  // The first sampled ones may be hard negatives, close to the examples.
+  vector<int32_t> hardIds;
+  if (!trainWord && rate > 0.0) {
+    hardNegatives(data, batch_exs, lhs, numSampled, hardIds);
+  }
+  vector<Base> labels;
+  for (size_t i = 0; i < numSampled; i++) {
+    if (i < hardIds.size()) {
+      data.getRHSCandidate(hardIds[i], labels);
+    } else if (trainWord) {
+      labels.clear();
+      data.getRandomWord(labels);
+    } else {
+      data.getRandomRHS(labels);
+    }
+    rhsN.emplace_back();
+    projectRHS(labels, rhsN.back());
+    check(rhsN.back());
+    negLabels.push_back(labels);
+  }
+}
+
+void EmbedModel::projectedSimilarities(
+    const vector<Matrix<Real>>& as,
+    const vector<Matrix<Real>>& bs,
+    Matrix<Real>& scores) {
+  using namespace boost::numeric::ublas;
+  if (as.empty() || bs.empty()) {
+    scores.reshape({ as.size(), bs.size() });
+    return;
+  }
+  const size_t cols = as[0].numCols();
+  auto stack = [cols](const std::vector<Matrix<Real>>& ms,
+                      Matrix<Real>& out) {
+    out.reshape({ ms.size(), cols });
+    for (size_t i = 0; i < ms.size(); i++) {
+      assert(ms[i].numRows() == 1 && ms[i].numCols() == cols);
+      std::copy(ms[i][0], ms[i][0] + cols, out[i]);
+    }
+  };
+  Matrix<Real> a, b;
+  stack(as, a);
+  stack(bs, b);
+  scores.matrix = prod(a.matrix, trans(b.matrix));
+}
+
+void EmbedModel::buildHardNegIndex(
+    const InternDataHandler& data,
+    const std::atomic<bool>& stop,
+    unsigned seed) {
+  const size_t n = data.numRHSCandidates();
+  const size_t dim = args_->dim;
+  vector<float> vectors(n * dim);
+  vector<Base> candidate;
+  Matrix<Real> projection;
+  for (size_t i = 0; i < n; i++) {
+    if (stop) {
+      return;
+    }
+    data.getRHSCandidate(i, candidate);
+    projectRHS(candidate, projection);
+    std::copy(projection[0], projection[0] + dim, &vectors[i * dim]);
+  }
+  // About sqrt(n) lists of sqrt(n) candidates.
+  size_t nlist = (std::max)(size_t(1), size_t(sqrt(double(n))));
+  auto index = std::make_shared<const IVFIndex>(
+      std::move(vectors), dim, nlist, seed);
+  hardNegData_ = &data;
+  std::atomic_store(&hardNegIndex_, index);
+  if (args_->verbose) {
+    cerr << "\nHard negatives index rebuilt with " << n << " candidates in "
+         << index->numLists() << " lists.\n";
+  }
+}
+
+void EmbedModel::hardNegatives(
+    const InternDataHandler& data,
+    const vector<ParseResults>& batch_exs,
+    const vector<Matrix<Real>>& lhs,
+    size_t limit,
+    vector<int32_t>& ids) const {
+  // Each example looks at this many lists.
+  const size_t kProbes = 8;
+  ids.clear();
+  auto index = std::atomic_load(&hardNegIndex_);
+  if (index == nullptr || hardNegData_ != &data || lhs.empty()) {
+    return;
+  }
+  limit = (std::min)(limit, size_t(args_->hardNegatives));
+  size_t perExample = (limit + lhs.size() - 1) / lhs.size();
+  // Candidates close to an example are often other positives of it, or of
+  // another example of the batch, which all the negatives are shared with.
+  auto isPositive = [&](int32_t id) {
+    for (const auto& ex : batch_exs) {
+      if (ex.source >= 0 && data.rhsCandidateOverlaps(id, ex.source)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  vector<int32_t> found;
+  for (const auto& query : lhs) {
+    index->search(query[0], perExample, kProbes, found);
+    for (auto id : found) {
+      if (ids.size() < limit &&
+          std::find(ids.begin(), ids.end(), id) == ids.end() &&
+          !isPositive(id)) {
+        ids.push_back(id);
+      }
+    }
+  }
+}
+
 void EmbedModel::backward(
     const vector<ParseResults>& batch_exs,
     const vector<vector<Base>>& batch_negLabels,
@@ -565,10 +766,11 @@ float EmbedModel::trainNLLBatch(
     const vector<ParseResults>& batch_exs,
     int32_t negSearchLimit,
     Real rate0,
-    bool trainWord) {
+    bool trainWord,
+    BatchStats* stats) {
 
   auto batch_sz = batch_exs.size();
-  std::vector<Matrix<Real>> lhs(batch_sz), rhsP(batch_sz), rhsN(negSearchLimit);
+  std::vector<Matrix<Real>> lhs(batch_sz), rhsP(batch_sz), rhsN;
 
   using namespace boost::numeric::ublas;
 
@@ -593,16 +795,12 @@ float EmbedModel::trainNLLBatch(
 
   Real total_loss = 0.0;
 
-  for (int i = 0; i < negSearchLimit; i++) {
-    std::vector<Base> negLabels;
-    if (trainWord) {
-      data->getRandomWord(negLabels);
-    } else {
-      data->getRandomRHS(negLabels);
-    }
-    projectRHS(negLabels, rhsN[i]);
-    check(rhsN[i]);
-    batch_negLabels.push_back(negLabels);
+  batchNegatives(*data, batch_exs, lhs, rhsP, negSearchLimit, rate0,
+                 trainWord, batch_negLabels, rhsN);
+  negSearchLimit = rhsN.size();
+  Matrix<Real> negSims;
+  if (args_->inBatchNeg) {
+    projectedSimilarities(lhs, rhsN, negSims);
   }
 
   for (int i = 0; i < batch_sz; i++) {
@@ -620,7 +818,8 @@ float EmbedModel::trainNLLBatch(
       if (batch_negLabels[j] == batch_exs[i].RHSTokens) {
         continue;
       }
-      prob[i].push_back(dot(lhs[i], rhsN[j]));
+      prob[i].push_back(args_->inBatchNeg ?
+                        negSims.matrix(i, j) : dot(lhs[i], rhsN[j]));
       max = (std::max)(prob[i][0], prob[i][cls_cnt]);
       index.push_back(j);
       cls_cnt += 1;
@@ -673,6 +872,12 @@ float EmbedModel::trainNLLBatch(
     }
     labelRate[i] = (prob[i][0] - 1) * rate0;
   }
+  if (stats != nullptr) {
+    for (auto n : num_negs) {
+      stats->violations += n;
+      stats->updates += (n > 0 && rate0 != 0.0);
+    }
+  }
 
   backward(
       batch_exs, batch_negLabels,
@@ -697,6 +902,43 @@ Real EmbedModel::cosine(const MatrixRow& a, const MatrixRow& b) {
   return dot(a, b) / sqrt(normA * normB);
 }
 
+Real EmbedModel::projectedSimilarity(
+    const Matrix<Real>& a,
+    const Matrix<Real>& b) {
+  assert(a.numRows() == 1 && b.numRows() == 1);
+  assert(a.numCols() == b.numCols());
+  const Real* pa = a[0];
+  const Real* pb = b[0];
+  Real retval = 0.0;
+  for (size_t i = 0; i < a.numCols(); i++) {
+    retval += pa[i] * pb[i];
+  }
+  return retval;
+}
+
+void EmbedModel::clearNormCache() {
+  std::lock_guard<std::mutex> lock(normCacheMutex_);
+  LHSInvNorms_.clear();
+  RHSInvNorms_.clear();
+}
+
+const vector<Real>& EmbedModel::inverseNorms(
+    const shared_ptr<SparseLinear<Real>>& lookup) {
+  std::lock_guard<std::mutex> lock(normCacheMutex_);
+  auto& invNorms = (lookup == LHSEmbeddings_) ? LHSInvNorms_ : RHSInvNorms_;
+  auto quant = quantizedTable(lookup);
+  size_t rows = (quant != nullptr) ? quant->numRows() : lookup->numRows();
+  if (invNorms.size() != rows) {
+    invNorms.resize(rows);
+    for (size_t i = 0; i < rows; i++) {
+      Real n = (quant != nullptr) ?
+        quant->squaredNorm(i) : dot(lookup->row(i), lookup->row(i));
+      invNorms[i] = (n == 0.0) ? 0.0 : 1.0 / sqrt(n);
+    }
+  }
+  return invNorms;
+}
+
 vector<pair<int32_t, Real>>
 EmbedModel::kNN(shared_ptr<SparseLinear<Real>> lookup,
                 Matrix<Real> point,
@@ -713,12 +955,35 @@ EmbedModel::kNN(shared_ptr<SparseLinear<Real>> lookup,
       std::sort(mostSimilar.begin(), mostSimilar.end(),
                [&](Cand a, Cand b) { return a.second > b.second; });
     };
-    Matrix<Real> contV;
 
+    // For cosine similarity, normalize the query once and scale each dot
+    // product by the cached inverse norm of the row, instead of recomputing
+    // both norms for every candidate.
+    const Real* invNorms = nullptr;
+    Real pointScale = 1.0;
+    if (args_->similarity != "dot") {
+      invNorms = inverseNorms(lookup).data();
+      auto n = dot(asRow(point), asRow(point));
+      pointScale = (n == 0.0) ? 0.0 : 1.0 / sqrt(n);
+    }
+
+    // Quantized tables are scored against the float query directly.
+    auto quant = quantizedTable(lookup);
+    const auto cols = lookup->numCols();
+    const Real* q = point[0];
     for (int i = 0; i < maxn; i++) {
-      lookup->forward(i, contV);
-      Real sim = (args_->similarity == "dot") ?
-          dot(point, contV) : cosine(point, contV);
+      Real sim = 0.0;
+      if (quant != nullptr) {
+        sim = quant->dot(q, i);
+      } else {
+        const Real* row = (*lookup)[i];
+        for (size_t j = 0; j < cols; j++) {
+          sim += q[j] * row[j];
+        }
+      }
+      if (invNorms != nullptr) {
+        sim *= pointScale * invNorms[i];
+      }
       if (sim > mostSimilar.back().second) {
         mostSimilar.back() = { i, sim };
         resort();
@@ -734,20 +999,38 @@ EmbedModel::kNN(shared_ptr<SparseLinear<Real>> lookup,
 
 void EmbedModel::loadTsvLine(string& line, int lineNum,
                              int cols, const string sep) {
-  vector<string> pieces;
-  static const string zero = "0.0";
+  string symbol;
+  loadTsvLine(line.data(), line.data() + line.size(), lineNum, cols, sep,
+              symbol);
+}
+
+void EmbedModel::loadTsvLine(const char* begin, const char* end, int lineNum,
+                             int cols, const string& sep, string& symbol) {
+  typedef pair<const char*, const char*> Field;
+  static thread_local vector<Field> pieces;
+  pieces.clear();
+  const char* lineEnd = end;
   // Strip trailing spaces
-  while (line.size() && isspace(line[line.size() - 1])) {
-    line.resize(line.size() - 1);
+  while (end > begin && isspace(end[-1])) {
+    end--;
   }
-  boost::split(pieces, line, boost::is_any_of(sep));
+  const char* fieldStart = begin;
+  for (const char* p = begin; p < end; p++) {
+    if (sep.find(*p) != string::npos) {
+      pieces.emplace_back(fieldStart, p);
+      fieldStart = p + 1;
+    }
+  }
+  pieces.emplace_back(fieldStart, end);
+
   if (pieces.size() > (unsigned int)(cols + 1)) {
     cout << "Hmm, truncating long (" << pieces.size() <<
         ") record at line " << lineNum;
     if (true) {
       for (size_t i = cols; i < pieces.size(); i++) {
-        cout << "Warning excess fields " << pieces[i]
-                      << "; misformatted file?";
+        cout << "Warning excess fields "
+             << string(pieces[i].first, pieces[i].second)
+             << "; misformatted file?";
       }
     }
     pieces.resize(cols + 1);
@@ -755,22 +1038,23 @@ void EmbedModel::loadTsvLine(string& line, int lineNum,
   if (pieces.size() == (unsigned int)cols) {
     cout << "Missing record at line " << lineNum <<
       "; assuming empty string";
-    pieces.insert(pieces.begin(), "");
+    pieces.insert(pieces.begin(), Field(begin, begin));
   }
-  while (pieces.size() < (unsigned int)(cols + 1)) {
+  if (pieces.size() < (unsigned int)(cols + 1)) {
     cout << "Zero-padding short record at line " << lineNum;
-    pieces.push_back(zero);
   }
-  auto idx = dict_->getId(pieces[0]);
+  symbol.assign(pieces[0].first, pieces[0].second);
+  auto idx = dict_->getId(symbol);
   if (idx == -1) {
-    if (pieces[0].size() > 0) {
-      cerr << "Failed to insert record: " << line << "\n";
+    if (symbol.size() > 0) {
+      cerr << "Failed to insert record: " << string(begin, lineEnd) << "\n";
     }
     return;
   }
-  auto row = LHSEmbeddings_->row(idx);
+  Real* row = (*LHSEmbeddings_)[idx];
   for (int i = 0; i < cols; i++) {
-    row(i) = boost::lexical_cast<Real>(pieces[i + 1].c_str());
+    row[i] = (i + 1 < (int)pieces.size()) ?
+      parse_float(pieces[i + 1].first, pieces[i + 1].second) : 0.0;
   }
 }
 
@@ -778,48 +1062,21 @@ void EmbedModel::loadTsv(const char* fname, const string sep) {
   cout << "Loading model from file " << fname << endl;
   auto cols = args_->dim;
 
-  std::ifstream ifs(fname);
-  auto filelen = [&](ifstream& f) {
-    auto pos = f.tellg();
-    f.seekg(0, ios_base::end);
-    auto retval = f.tellg();
-    f.seekg(pos, ios_base::beg);
-    return retval;
-  };
-
-  auto len = filelen(ifs);
   auto numThreads = getNumberOfCores();
-  vector<off_t> partitions(numThreads + 1);
-  partitions[0] = 0;
-  partitions[numThreads] = len;
-
-  string unused;
-  for (int i = 1; i < numThreads; i++) {
-    ifs.seekg((len / numThreads) * i);
-    getline(ifs, unused);
-    partitions[i] = ifs.tellg();
-  }
-
-  // It's possible that the ranges in partitions overlap; consider,
-  // e.g., a machine with 100 hardware threads and only 99 lines
-  // in the file. In this case, we'll do some excess work but loadTsvLine
-  // is idempotent, so it is ok.
-  std::vector<thread> threads;
-  for (int i = 0; i < numThreads; i++) {
-    auto body = [this, fname, cols, sep, i, &partitions]() {
-      // Get our own seek pointer.
-      ifstream ifs(fname);
-      ifs.seekg(partitions[i]);
-      string line;
-      while (ifs.tellg() < partitions[i + 1] && getline(ifs, line)) {
-        // We don't know the line number. Super-bummer.
-        loadTsvLine(line, -1, cols, sep);
-      }
-    };
-    threads.emplace_back(body);
-  }
-  for (auto& t: threads) {
-    t.join();
+  // Each thread parses the lines of its own byte range straight out of the
+  // mapped file.
+  vector<string> symbols(numThreads);
+  bool opened = read_lines(
+    fname,
+    [&](int i, boost::string_view line) {
+      // We don't know the line number. Super-bummer.
+      loadTsvLine(line.data(), line.data() + line.size(), -1, cols, sep,
+                  symbols[i]);
+    },
+    numThreads);
+  if (!opened) {
+    std::cerr << "Model file cannot be opened for loading!" << std::endl;
+    exit(EXIT_FAILURE);
   }
 
   cout << "Model loaded.\n";
@@ -838,20 +1095,81 @@ void EmbedModel::loadTsv(istream& in, const string sep) {
 }
 
 void EmbedModel::saveTsv(ostream& out, const char sep) const {
-  auto dumpOne = [&](shared_ptr<SparseLinear<Real>> emb) {
-    auto size =  dict_->nwords() + dict_->nlabels();
-    for (size_t i = 0; i < (size_t)size; i++) {
-      // Skip invalid IDs.
-      string symbol = dict_->getSymbol(i);
-      out << symbol;
-      emb->forRow(i,
-                 [&](Real r, size_t j) {
-        out << sep << r;
-      });
-      out << "\n";
+  if (isQuantized()) {
+    cerr << "A quantized model cannot be saved in tsv format." << endl;
+    exit(EXIT_FAILURE);
+  }
+  // Rows are formatted in chunks by worker threads, which claim chunks in
+  // order, while this thread writes the finished ones out in order. Chunk c
+  // is formatted into slot c % numSlots once the chunk that used the slot
+  // before has been written, so at most numSlots chunks are held at once.
+  // Cells are printed with %g, which is what ostream's default float
+  // formatting produces.
+  const size_t kRowsPerChunk = 4096;
+  const size_t size = dict_->nwords() + dict_->nlabels();
+  const size_t cols = LHSEmbeddings_->numCols();
+  const size_t numThreads = (std::max)(1, args_->thread);
+  const size_t numChunks = (size + kRowsPerChunk - 1) / kRowsPerChunk;
+  const size_t numSlots = 2 * numThreads;
+  const size_t kNone = size_t(-1);
+  vector<string> slots(numSlots);
+  // Chunk formatted in each slot, and number of chunks written so far.
+  vector<size_t> formatted(numSlots, kNone);
+  size_t written = 0;
+  std::atomic<size_t> nextChunk(0);
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  auto formatRows = [&](size_t begin, size_t end, string& buf) {
+    buf.clear();
+    char num[32];
+    for (size_t i = begin; i < end; i++) {
+      auto symbol = dict_->getSymbol(i);
+      buf.append(symbol.data(), symbol.size());
+      const Real* row = (*LHSEmbeddings_)[i];
+      for (size_t j = 0; j < cols; j++) {
+        buf.push_back(sep);
+        buf.append(num, snprintf(num, sizeof(num), "%g", row[j]));
+      }
+      buf.push_back('\n');
     }
   };
-  dumpOne(LHSEmbeddings_);
+
+  vector<thread> threads;
+  for (size_t t = 0; t < (std::min)(numThreads, numChunks); t++) {
+    threads.emplace_back([&] {
+      for (size_t c = nextChunk++; c < numChunks; c = nextChunk++) {
+        const size_t slot = c % numSlots;
+        {
+          unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&] { return c < written + numSlots; });
+        }
+        formatRows(c * kRowsPerChunk,
+                   (std::min)(size, (c + 1) * kRowsPerChunk), slots[slot]);
+        {
+          lock_guard<std::mutex> lock(mutex);
+          formatted[slot] = c;
+        }
+        cv.notify_all();
+      }
+    });
+  }
+  for (size_t c = 0; c < numChunks; c++) {
+    const size_t slot = c % numSlots;
+    {
+      unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return formatted[slot] == c; });
+    }
+    out.write(slots[slot].data(), slots[slot].size());
+    {
+      lock_guard<std::mutex> lock(mutex);
+      written = c + 1;
+    }
+    cv.notify_all();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
 }
 
 void EmbedModel::save(ostream& out) const {
@@ -868,6 +1186,400 @@ void EmbedModel::load(ifstream& in) {
   } else {
     RHSEmbeddings_.reset(new SparseLinear<Real>(in));
   }
+  if (args_->adagrad) {
+    LHSUpdates_.resize(LHSEmbeddings_->numRows());
+    RHSUpdates_.resize(RHSEmbeddings_->numRows());
+  }
+}
+
+namespace {
+
+const uint64_t kTableAlign = 64;
+
+// Reverse the byte order of every float in place.
+void swapBytes(char* data, uint64_t len) {
+  for (uint64_t i = 0; i + sizeof(Real) <= len; i += sizeof(Real)) {
+    std::reverse(data + i, data + i + sizeof(Real));
+  }
+}
+
+void writeTable(
+    ostream& out,
+    const SparseLinear<Real>& table,
+    bool checksum,
+    int numThreads) {
+  uint64_t rows = table.numRows();
+  uint64_t cols = table.numCols();
+  uint64_t len = rows * cols * sizeof(Real);
+  const char* data = (len > 0) ? (const char*)table[0] : nullptr;
+
+  vector<char> swapped;
+  if (!isLittleEndian()) {
+    swapped.assign(data, data + len);
+    swapBytes(swapped.data(), len);
+    data = swapped.data();
+  }
+  uint64_t sum = checksum ? block_checksum(data, len, numThreads) : 0;
+
+  out.write((char*) &rows, sizeof(uint64_t));
+  out.write((char*) &cols, sizeof(uint64_t));
+  out.write((char*) &sum, sizeof(uint64_t));
+  static const char zeros[kTableAlign] = {};
+  uint64_t pos = out.tellp();
+  out.write(zeros, (kTableAlign - pos % kTableAlign) % kTableAlign);
+  out.write(data, len);
+}
+
+// Point table at its cells in fname rather than reading them.
+bool mapTable(
+    const string& fname,
+    uint64_t offset,
+    uint64_t rows,
+    uint64_t cols,
+    SparseLinear<Real>& table,
+    bool writable,
+    bool shared) {
+#ifdef _WIN32
+  return false;
+#else
+  if (!isLittleEndian()) {
+    return false;
+  }
+  int fd = open(fname.c_str(), writable && shared ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  auto& data = table.matrix.data();
+  bool mapped = data.map(fd, offset, rows * cols, writable, shared);
+  close(fd);
+  if (mapped) {
+    // Keeps the mapping, since the size does not change.
+    table.matrix.resize(rows, cols, false);
+    // Rows are looked up at random; reading ahead only evicts useful pages.
+    data.advise(0, rows * cols, MADV_RANDOM);
+  }
+  return mapped;
+#endif
+}
+
+// Reads a table written by writeTable. If map is set, the table is mapped
+// from fname instead when possible (writable and shared as in
+// MappedArray::map), and the file offset of its checksum is returned
+// through checksumPos.
+void readTable(
+    istream& in,
+    const string& fname,
+    SparseLinear<Real>& table,
+    bool checksum,
+    int numThreads,
+    bool map = false,
+    bool writable = false,
+    bool shared = false,
+    uint64_t* checksumPos = nullptr) {
+  uint64_t rows, cols, sum;
+  in.read((char*) &rows, sizeof(uint64_t));
+  in.read((char*) &cols, sizeof(uint64_t));
+  uint64_t sumPos = in.tellg();
+  in.read((char*) &sum, sizeof(uint64_t));
+  if (!in) {
+    cerr << "Model file is truncated!" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t offset = in.tellg();
+  offset += (kTableAlign - offset % kTableAlign) % kTableAlign;
+  uint64_t len = rows * cols * sizeof(Real);
+  if (map && len > 0 &&
+      mapTable(fname, offset, rows, cols, table, writable, shared)) {
+    if (checksumPos != nullptr) {
+      *checksumPos = sumPos;
+    }
+    in.seekg(offset + len);
+    return;
+  }
+  if (map && len > 0) {
+    cerr << "Could not map the model file, reading it instead." << endl;
+  }
+
+  table.matrix.resize(rows, cols, false);
+  if (len > 0) {
+    char* data = (char*)table[0];
+    parallel_read(fname, offset, data, len, numThreads);
+    if (checksum && block_checksum(data, len, numThreads) != sum) {
+      cerr << "Model file checksum mismatch! The file may be corrupted."
+           << endl;
+      exit(EXIT_FAILURE);
+    }
+    if (!isLittleEndian()) {
+      swapBytes(data, len);
+    }
+  }
+  in.seekg(offset + len);
+}
+
+}
+
+void EmbedModel::saveBinary(ostream& out, bool checksum) const {
+  if (isQuantized()) {
+    LHSQuant_->save(out, checksum, args_->thread);
+    if (!args_->shareEmb) {
+      RHSQuant_->save(out, checksum, args_->thread);
+    }
+    return;
+  }
+  writeTable(out, *LHSEmbeddings_, checksum, args_->thread);
+  if (!args_->shareEmb) {
+    writeTable(out, *RHSEmbeddings_, checksum, args_->thread);
+  }
+}
+
+void EmbedModel::loadBinary(
+    istream& in,
+    const string& fname,
+    bool checksum,
+    bool quantized) {
+  if (quantized) {
+    LHSQuant_ = make_shared<QMatrix>();
+    LHSQuant_->load(in, checksum, args_->thread);
+    if (args_->shareEmb) {
+      RHSQuant_ = LHSQuant_;
+    } else {
+      RHSQuant_ = make_shared<QMatrix>();
+      RHSQuant_->load(in, checksum, args_->thread);
+    }
+    releaseFloatTables();
+    return;
+  }
+  // Training updates a mapped model in copy-on-write pages, and only
+  // writes them back to fname with args.mmapWriteBack.
+  const bool map = args_->mmapModel;
+  const bool writable = map && args_->isTrain;
+  const bool writeBack = writable && args_->mmapWriteBack;
+  if (writable && fname == args_->model) {
+    cerr << "-model must differ from -initModel when training with "
+         << "-mmapModel, as saving would overwrite the mapped file." << endl;
+    exit(EXIT_FAILURE);
+  }
+  mappedFile_.clear();
+  mappedChecksumPos_.clear();
+  uint64_t sumPos = 0;
+  readTable(in, fname, *LHSEmbeddings_, checksum, args_->thread,
+            map, writable, writeBack, &sumPos);
+  if (writeBack && checksum && LHSEmbeddings_->matrix.data().isMapped()) {
+    mappedChecksumPos_.push_back(sumPos);
+  }
+  if (args_->shareEmb) {
+    RHSEmbeddings_ = LHSEmbeddings_;
+  } else {
+    readTable(in, fname, *RHSEmbeddings_, checksum, args_->thread,
+              map, writable, writeBack, &sumPos);
+    if (writeBack && checksum && RHSEmbeddings_->matrix.data().isMapped()) {
+      mappedChecksumPos_.push_back(sumPos);
+    }
+  }
+  if (writeBack) {
+    mappedFile_ = fname;
+  }
+  if (args_->adagrad) {
+    LHSUpdates_.resize(LHSEmbeddings_->numRows());
+    RHSUpdates_.resize(RHSEmbeddings_->numRows());
+  }
+}
+
+void EmbedModel::pinRows(const string& fname) {
+  ifstream in(fname);
+  if (!in.is_open()) {
+    cerr << "Pin list " << fname << " cannot be opened!" << endl;
+    exit(EXIT_FAILURE);
+  }
+  size_t pinned = 0, prefetched = 0, unknown = 0;
+  auto pin = [&](SparseLinear<Real>& table, int32_t id) {
+    auto cols = table.numCols();
+    if (table.matrix.data().lock(id * cols, (id + 1) * cols)) {
+      pinned++;
+    } else {
+      prefetched++;
+    }
+  };
+  string symbol;
+  while (getline(in, symbol)) {
+    boost::algorithm::trim(symbol);
+    if (symbol.empty()) {
+      continue;
+    }
+    int32_t id = dict_->getId(symbol);
+    if (id < 0 || id >= (int32_t)LHSEmbeddings_->numRows()) {
+      unknown++;
+      continue;
+    }
+    pin(*LHSEmbeddings_, id);
+    if (!args_->shareEmb) {
+      pin(*RHSEmbeddings_, id);
+    }
+  }
+  cout << "Pinned " << pinned << " rows in memory";
+  if (prefetched > 0) {
+    cout << ", prefetched " << prefetched
+         << " more (raise the locked memory limit to pin them)";
+  }
+  if (unknown > 0) {
+    cout << ", skipped " << unknown << " unknown symbols";
+  }
+  cout << ".\n";
+}
+
+void EmbedModel::sync() {
+  if (mappedFile_.empty()) {
+    return;
+  }
+  vector<shared_ptr<SparseLinear<Real>>> tables{ LHSEmbeddings_ };
+  if (!args_->shareEmb) {
+    tables.push_back(RHSEmbeddings_);
+  }
+  for (auto& table : tables) {
+    if (!table->matrix.data().sync()) {
+      cerr << "Could not write the model back to " << mappedFile_ << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (mappedChecksumPos_.empty()) {
+    return;
+  }
+  fstream out(mappedFile_, ios::in | ios::out | ios::binary);
+  for (size_t i = 0; i < mappedChecksumPos_.size(); i++) {
+    const auto& table = *tables[i];
+    uint64_t sum = block_checksum(
+        (const char*)table[0], table.numElts() * sizeof(Real), args_->thread);
+    out.seekp(mappedChecksumPos_[i]);
+    out.write((char*) &sum, sizeof(uint64_t));
+  }
+  if (!out) {
+    cerr << "Could not update the checksums of " << mappedFile_ << endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void EmbedModel::prune(int32_t cutoff) {
+  assert(!isQuantized());
+  const int32_t nwords = dict_->nwords();
+  const int32_t nlabels = dict_->nlabels();
+
+  // The cutoff most frequent words, in their current order.
+  vector<int32_t> words(nwords);
+  std::iota(words.begin(), words.end(), 0);
+  if (cutoff < nwords) {
+    std::stable_sort(words.begin(), words.end(), [&](int32_t a, int32_t b) {
+      return dict_->getCount(a) > dict_->getCount(b);
+    });
+    words.resize(cutoff);
+    std::sort(words.begin(), words.end());
+  }
+
+  // Ngram buckets that were never updated in training still hold their
+  // small random initial value; keep only those that have grown beyond it
+  // on either side.
+  const Real minNorm = 2.0 * args_->initRandSd * sqrt(Real(args_->dim));
+  auto trained = [&](const SparseLinear<Real>& table, int64_t row) {
+    const Real* r = table[row];
+    Real n = 0.0;
+    for (size_t j = 0; j < table.numCols(); j++) {
+      n += r[j] * r[j];
+    }
+    return n > minNorm * minNorm;
+  };
+  vector<int64_t> buckets;
+  vector<int64_t> bucketRows;
+  if (args_->ngrams > 1) {
+    for (int64_t b = 0; b < args_->bucket; b++) {
+      auto idx = dict_->ngramIndex(b);
+      if (idx < 0) {
+        continue;
+      }
+      auto row = nwords + nlabels + idx;
+      if (trained(*LHSEmbeddings_, row) || trained(*RHSEmbeddings_, row)) {
+        buckets.push_back(b);
+        bucketRows.push_back(row);
+      }
+    }
+  }
+
+  vector<int64_t> rows(words.begin(), words.end());
+  for (int32_t i = 0; i < nlabels; i++) {
+    rows.push_back(nwords + i);
+  }
+  rows.insert(rows.end(), bucketRows.begin(), bucketRows.end());
+
+  auto select = [&](const SparseLinear<Real>& table) {
+    auto retval = make_shared<SparseLinear<Real>>(
+        MatrixDims{rows.size(), table.numCols()}, 0.0);
+    for (size_t i = 0; i < rows.size(); i++) {
+      memcpy((*retval)[i], table[rows[i]], table.numCols() * sizeof(Real));
+    }
+    return retval;
+  };
+  auto lhs = select(*LHSEmbeddings_);
+  if (args_->shareEmb) {
+    RHSEmbeddings_ = lhs;
+  } else {
+    RHSEmbeddings_ = select(*RHSEmbeddings_);
+  }
+  LHSEmbeddings_ = lhs;
+  if (args_->adagrad) {
+    LHSUpdates_.assign(LHSEmbeddings_->numRows(), 0.0);
+    RHSUpdates_.assign(RHSEmbeddings_->numRows(), 0.0);
+  }
+  clearNormCache();
+
+  dict_->prune(words, buckets);
+  cout << "Pruned the model to " << words.size() << " words and "
+       << buckets.size() << " ngram buckets.\n";
+}
+
+void EmbedModel::quantize() {
+  if (isQuantized()) {
+    return;
+  }
+  LHSQuant_ = make_shared<QMatrix>(*LHSEmbeddings_);
+  if (args_->shareEmb) {
+    RHSQuant_ = LHSQuant_;
+  } else {
+    RHSQuant_ = make_shared<QMatrix>(*RHSEmbeddings_);
+  }
+  releaseFloatTables();
+}
+
+// Keep empty float tables around so that their column count and the
+// LHS / RHS identity used by kNN stay available.
+void EmbedModel::releaseFloatTables() {
+  LHSEmbeddings_.reset(new SparseLinear<Real>({0, args_->dim}, 0.0));
+  if (args_->shareEmb) {
+    RHSEmbeddings_ = LHSEmbeddings_;
+  } else {
+    RHSEmbeddings_.reset(new SparseLinear<Real>({0, args_->dim}, 0.0));
+  }
+  vector<Real>().swap(LHSUpdates_);
+  vector<Real>().swap(RHSUpdates_);
+  clearNormCache();
+}
+
+size_t EmbedModel::tableMemoryUsage() const {
+  if (isQuantized()) {
+    size_t retval = LHSQuant_->memoryUsage();
+    if (RHSQuant_ != LHSQuant_) {
+      retval += RHSQuant_->memoryUsage();
+    }
+    return retval;
+  }
+  size_t retval = LHSEmbeddings_->numElts() * sizeof(Real);
+  if (RHSEmbeddings_ != LHSEmbeddings_) {
+    retval += RHSEmbeddings_->numElts() * sizeof(Real);
+  }
+  return retval;
+}
+
+size_t EmbedModel::memoryUsage() const {
+  return tableMemoryUsage()
+       + (LHSUpdates_.capacity() + RHSUpdates_.capacity()) * sizeof(Real);
 }
 
 }
@@ -9,6 +9,9 @@
 
 #include "matrix.h"
 #include "proj.h"
+#include "qmatrix.h"
+#include "ivf_index.h"
+#include "train_monitor.h"
 #include "dict.h"
 #include "utils/normalize.h"
 #include "utils/args.h"
@@ -17,6 +20,8 @@
 
 #include <fstream>
 #include <boost/noncopyable.hpp>
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 
@@ -33,8 +38,11 @@ typedef boost::numeric::ublas::vector<Real> Vector;
  */
 struct EmbedModel : public boost::noncopyable {
 public:
+  // randomInit can be turned off when the weights are about to be
+  // overwritten by a saved model anyway.
   explicit EmbedModel(std::shared_ptr<Args> args,
-                      std::shared_ptr<Dictionary> dict);
+                      std::shared_ptr<Dictionary> dict,
+                      bool randomInit = true);
 
 
   typedef std::vector<ParseResults> Corpus;
@@ -52,17 +60,57 @@ public:
 		       0.0, 0.0, false);
   }
 
+  // What a batch did, for the TrainMonitor.
+  struct BatchStats {
+    // Negatives scored within the margin of the positive; with softmax,
+    // all those scored.
+    long violations = 0;
+    // Examples whose gradient was applied.
+    long updates = 0;
+  };
+
   float trainOneBatch(std::shared_ptr<InternDataHandler> data,
                  const std::vector<ParseResults>& batch_exs,
                  size_t negSearchLimits,
                  Real rate,
-                 bool trainWord = false);
+                 bool trainWord = false,
+                 BatchStats* stats = nullptr);
 
   float trainNLLBatch(std::shared_ptr<InternDataHandler> data,
                  const std::vector<ParseResults>& batch_exs,
                  int32_t negSearchLimit,
                  Real rate,
-                 bool trainWord = false);
+                 bool trainWord = false,
+                 BatchStats* stats = nullptr);
+
+  // The negatives of a batch: with -inBatchNeg, the positives of the
+  // batch, then sampled ones up to negSearchLimit in all. rhsP holds the
+  // projections of the positives.
+  void batchNegatives(const InternDataHandler& data,
+                      const std::vector<ParseResults>& batch_exs,
+                      const std::vector<Matrix<Real>>& lhs,
+                      const std::vector<Matrix<Real>>& rhsP,
+                      size_t negSearchLimit,
+                      Real rate,
+                      bool trainWord,
+                      std::vector<std::vector<Base>>& negLabels,
+                      std::vector<Matrix<Real>>& rhsN);
+
+  // Ids of RHS candidates of data (see InternDataHandler::getRHSCandidate)
+  // close to the examples of a batch, whose projections are lhs, from the
+  // hard negatives index: up to -hardNegatives of them, and at most limit.
+  // Candidates overlapping the RHS of the source example of any of
+  // batch_exs are left out. None while there is no index.
+  void hardNegatives(const InternDataHandler& data,
+                     const std::vector<ParseResults>& batch_exs,
+                     const std::vector<Matrix<Real>>& lhs,
+                     size_t limit,
+                     std::vector<int32_t>& ids) const;
+  // Project every RHS candidate of data and index them, unless stop is
+  // set first.
+  void buildHardNegIndex(const InternDataHandler& data,
+                         const std::atomic<bool>& stop,
+                         unsigned seed);
 
   void backward(const std::vector<ParseResults>& batch_exs,
                 const std::vector<std::vector<Base>>& negLabels,
@@ -107,15 +155,54 @@ public:
 
   void load(std::ifstream& in);
 
-  const std::string& lookupLHS(int32_t idx) const {
+  // Binary format: every table is written as its row count, column count and
+  // checksum, followed by its cells as little-endian float32 starting at a
+  // 64-byte aligned file offset. Loading reads the cells of each table in
+  // parallel straight from fname.
+  // Quantized models store QMatrix tables instead.
+  void saveBinary(std::ostream& out, bool checksum) const;
+  // With args.mmapModel, float tables are mapped from fname instead, and
+  // are paged in as rows are used; see pinRows and sync.
+  void loadBinary(std::istream& in, const std::string& fname, bool checksum,
+                  bool quantized = false);
+
+  // Lock the rows of the symbols listed in fname, one per line, in memory.
+  // Only meaningful for mapped tables.
+  void pinRows(const std::string& fname);
+
+  // With args.mmapWriteBack, flush updates made to tables mapped for
+  // training back to the model file, and refresh its checksums. No-op
+  // otherwise.
+  void sync();
+
+  // Keep only the cutoff most frequent words (all labels are kept) and
+  // the ngram buckets that were updated in training, and prune the
+  // dictionary accordingly.
+  void prune(int32_t cutoff);
+
+  // Replace the float lookup tables by int8 quantized ones. Projection and
+  // kNN then score directly against the quantized rows; the model can no
+  // longer be trained or exported as tsv.
+  void quantize();
+  bool isQuantized() const { return LHSQuant_ != nullptr; }
+  // Bytes taken by the lookup tables.
+  size_t tableMemoryUsage() const;
+  // Same, with the adagrad state kept for training.
+  size_t memoryUsage() const;
+
+  boost::string_view lookupLHS(int32_t idx) const {
     return dict_->getSymbol(idx);
   }
-  const std::string& lookupRHS(int32_t idx) const {
+  boost::string_view lookupRHS(int32_t idx) const {
     return dict_->getLabel(idx);
   }
 
   void loadTsvLine(std::string& line, int lineNum, int cols,
                    const std::string sep = "\t");
+  // Parse the line [begin, end) in place. symbol is scratch space for the
+  // first field, reused across calls to avoid allocating.
+  void loadTsvLine(const char* begin, const char* end, int lineNum, int cols,
+                   const std::string& sep, std::string& symbol);
 
   std::shared_ptr<Dictionary> getDict() { return dict_; }
 
@@ -132,7 +219,11 @@ public:
     return RHSEmbeddings_;
   }
 
-  void initModelWeights();
+  void initModelWeights(bool randomInit = true);
+
+  // A copy of the model that shares its dictionary and arguments, but not
+  // its lookup tables or training state.
+  std::shared_ptr<EmbedModel> snapshot() const;
 
   Real similarity(const MatrixRow& a, const MatrixRow& b);
   Real similarity(Matrix<Real>& a, Matrix<Real>& b) {
@@ -144,6 +235,22 @@ public:
     return cosine(asRow(a), asRow(b));
   }
 
+  // Similarity between two outputs of projectLHS / projectRHS. With
+  // cosine similarity projections are already unit length, so the score
+  // reduces to a plain dot product and the norms need not be recomputed.
+  static Real projectedSimilarity(const Matrix<Real>& a, const Matrix<Real>& b);
+  // The same for every pair of a in as and b in bs, with one matrix
+  // product: scores(i, j) is the similarity of as[i] and bs[j].
+  static void projectedSimilarities(const std::vector<Matrix<Real>>& as,
+                                    const std::vector<Matrix<Real>>& bs,
+                                    Matrix<Real>& scores);
+
+  // Inverse L2 norm of every row of the given lookup table, computed once
+  // and reused by cosine scoring in kNN. Cleared whenever training starts.
+  const std::vector<Real>& inverseNorms(
+      const std::shared_ptr<SparseLinear<Real>>& lookup);
+  void clearNormCache();
+
   static MatrixRow asRow(Matrix<Real>& m) {
     assert(m.numRows() == 1);
     return MatrixRow(m.matrix, 0);
@@ -156,22 +263,44 @@ private:
   std::shared_ptr<Dictionary> dict_;
   std::shared_ptr<SparseLinear<Real>> LHSEmbeddings_;
   std::shared_ptr<SparseLinear<Real>> RHSEmbeddings_;
+  std::shared_ptr<QMatrix> LHSQuant_;
+  std::shared_ptr<QMatrix> RHSQuant_;
   std::shared_ptr<Args> args_;
 
   std::vector<Real> LHSUpdates_;
   std::vector<Real> RHSUpdates_;
 
+  // Model file the tables are mapped shared and writable from, and the
+  // offsets of their checksums in it (empty if it has none).
+  std::string mappedFile_;
+  std::vector<uint64_t> mappedChecksumPos_;
+
+  // Index of the projected RHS candidates of hardNegData_, replaced as a
+  // whole by the thread that rebuilds it; see buildHardNegIndex.
+  std::shared_ptr<const IVFIndex> hardNegIndex_;
+  std::atomic<const InternDataHandler*> hardNegData_{nullptr};
+
+  std::mutex normCacheMutex_;
+  std::vector<Real> LHSInvNorms_;
+  std::vector<Real> RHSInvNorms_;
+
 #ifdef NDEBUG
   static const bool debug = false;
 #else
   static const bool debug = false;
 #endif
 
+  void releaseFloatTables();
+  std::shared_ptr<QMatrix> quantizedTable(
+      const std::shared_ptr<SparseLinear<Real>>& lookup) const {
+    return (lookup == LHSEmbeddings_) ? LHSQuant_ : RHSQuant_;
+  }
+
   static void check(const Matrix<Real>& m) {
     m.sanityCheck();
   }
 
-  static void check(const boost::numeric::ublas::matrix<Real>& m) {
+  static void check(const Matrix<Real>::UblasMatrix& m) {
     if (!debug) return;
     for (unsigned int i = 0; i < m.size1(); i++) {
       for (unsigned int j = 0; j < m.size2(); j++) {
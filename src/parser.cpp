@@ -8,24 +8,39 @@
 
 #include "parser.h"
 #include "utils/normalize.h"
+#include "utils/utils.h"
 #include <string>
 #include <vector>
 #include <fstream>
 #include <iostream>
-
-#include <boost/algorithm/string.hpp>
+#include <cstring>
 
 using namespace std;
 
 namespace starspace {
 
-void chomp(std::string& line, char toChomp = '\n') {
-  auto sz = line.size();
-  if (sz >= 1 && line[sz - 1] == toChomp) {
-    line.resize(sz - 1);
+namespace {
+
+void chomp(boost::string_view& line, char toChomp = '\n') {
+  if (!line.empty() && line.back() == toChomp) {
+    line.remove_suffix(1);
   }
 }
 
+// Per-thread token list, reused across lines.
+std::vector<boost::string_view>& scratchTokens() {
+  static thread_local std::vector<boost::string_view> tokens;
+  return tokens;
+}
+
+// Per-thread hashes of the word tokens of a line, reused across lines.
+std::vector<int32_t>& scratchWordHashes() {
+  static thread_local std::vector<int32_t> hashes;
+  return hashes;
+}
+
+}
+
 DataParser::DataParser(
     shared_ptr<Dictionary> dict,
     shared_ptr<Args> args) {
@@ -33,39 +48,61 @@ DataParser::DataParser(
   args_ = args;
 }
 
+bool DataParser::parseToken(
+    boost::string_view token,
+    boost::string_view& symbol,
+    float& weight,
+    string& scratch,
+    uint32_t* h) const {
+  symbol = token;
+  weight = 1.0;
+  if (args_->useWeight) {
+    std::size_t pos = token.find(args_->weightSep);
+    if (pos != boost::string_view::npos) {
+      symbol = token.substr(0, pos);
+      weight = parse_float(token.data() + pos + 1, token.data() + token.size());
+    }
+  }
+  if (args_->normalizeText) {
+    scratch.assign(symbol.data(), symbol.size());
+    if (h) {
+      *h = normalize_text_hash(scratch);
+    } else {
+      normalize_text(scratch);
+    }
+    symbol = scratch;
+  } else if (h && symbol.size() != token.size()) {
+    *h = Dictionary::hash(symbol);
+  }
+  return symbol.find("__weight__") == boost::string_view::npos;
+}
+
 bool DataParser::parse(
-    std::string& s,
+    boost::string_view line,
     ParseResults& rslts,
     const string& sep) {
 
-  chomp(s);
-  vector<string> toks;
-  boost::split(toks, s, boost::is_any_of(string(sep)));
+  chomp(line);
+  auto& tokens = scratchTokens();
+  split_tokens(line, sep, tokens);
 
-  return parse(toks, rslts);
+  return parse(tokens, rslts);
 }
 
 void DataParser::parseForDict(
-    string& line,
+    boost::string_view s,
     vector<string>& tokens,
     const string& sep) {
 
-  chomp(line);
-  vector<string> toks;
-  boost::split(toks, line, boost::is_any_of(string(sep)));
-  for (unsigned int i = 0; i < toks.size(); i++) {
-    string token = toks[i];
-    if (args_->useWeight) {
-      std::size_t pos = toks[i].find(args_->weightSep);
-      if (pos != std::string::npos) {
-        token = toks[i].substr(0, pos);
-      }
-    }
-    if (args_->normalizeText) {
-      normalize_text(token);
-    }
-    if (token.find("__weight__") == std::string::npos) {
-      tokens.push_back(token);
+  chomp(s);
+  auto& toks = scratchTokens();
+  split_tokens(s, sep, toks);
+  string scratch;
+  for (auto token : toks) {
+    boost::string_view symbol;
+    float weight;
+    if (parseToken(token, symbol, weight, scratch)) {
+      tokens.emplace_back(symbol.data(), symbol.size());
     }
   }
 }
@@ -84,56 +121,156 @@ bool DataParser::check(const ParseResults& example) {
   }
 }
 
+void DataParser::hashToken(
+    const Dictionary& dict,
+    boost::string_view token,
+    uint32_t& h,
+    std::vector<int32_t>& wordHashes) const {
+  h = dict.hash(token);
+  if (dict.getType(token) == entry_type::word) {
+    wordHashes.push_back(h);
+  }
+}
+
+void DataParser::ngramBuckets(
+    const std::vector<int32_t>& hashes,
+    int32_t n,
+    std::vector<int64_t>& buckets) const {
+
+  for (int32_t i = 0; i < (int32_t)(hashes.size()); i++) {
+    uint64_t h = hashes[i];
+    for (int32_t j = i + 1; j < (int32_t)(hashes.size()) && j < i + n; j++) {
+      h = h * Dictionary::HASH_C + hashes[j];
+      buckets.push_back(h % args_->bucket);
+    }
+  }
+}
+
 void DataParser::addNgrams(
-    const std::vector<std::string>& tokens,
+    const std::vector<boost::string_view>& tokens,
     std::vector<Base>& line,
     int n) {
 
   vector<int32_t> hashes;
-
-  for (auto token: tokens) {
-    entry_type type = dict_->getType(token);
-    if (type == entry_type::word) {
-      hashes.push_back(dict_->hash(token));
-    }
+  uint32_t h;
+  for (auto token : tokens) {
+    hashToken(*dict_, token, h, hashes);
   }
+  addNgrams(hashes, line, n);
+}
 
-  for (int32_t i = 0; i < (int32_t)(hashes.size()); i++) {
-    uint64_t h = hashes[i];
-    for (int32_t j = i + 1; j < (int32_t)(hashes.size()) && j < i + n; j++) {
-      h = h * Dictionary::HASH_C + hashes[j];
-      int64_t id = h % args_->bucket;
+void DataParser::addNgrams(
+    const std::vector<int32_t>& wordHashes,
+    std::vector<Base>& line,
+    int n) {
+
+  static thread_local vector<int64_t> buckets;
+  buckets.clear();
+  ngramBuckets(wordHashes, n, buckets);
+  for (auto bucket : buckets) {
+    int64_t id = dict_->ngramIndex(bucket);
+    if (id >= 0) {
       line.push_back(make_pair(dict_->nwords() + dict_->nlabels() + id, 1.0));
     }
   }
 }
 
-bool DataParser::parse(
-    const std::vector<std::string>& tokens,
-    ParseResults& rslts) {
+void DataParser::parseAndCount(
+    boost::string_view line,
+    ParseResults& rslts,
+    Dictionary& counts,
+    const string& sep) {
+
+  chomp(line);
+  auto& tokens = scratchTokens();
+  split_tokens(line, sep, tokens);
 
-  for (auto &token: tokens) {
-    if (token.find("__weight__") != std::string::npos) {
+  // Same token handling as parse(), with every token counted as in
+  // parseForDict().
+  auto& wordHashes = scratchWordHashes();
+  wordHashes.clear();
+  string scratch;
+  for (auto token: tokens) {
+    uint32_t h;
+    hashToken(counts, token, h, wordHashes);
+    if (token.find("__weight__") != boost::string_view::npos) {
       std::size_t pos = token.find(args_->weightSep);
-      if (pos != std::string::npos) {
-        rslts.weight = atof(token.substr(pos + 1).c_str());
+      if (pos != boost::string_view::npos) {
+        rslts.weight =
+          parse_float(token.data() + pos + 1, token.data() + token.size());
       }
       continue;
     }
-    string t = token;
-    float weight = 1.0;
-    if (args_->useWeight) {
-      std::size_t pos = token.find(args_->weightSep);
-      if (pos != std::string::npos) {
-        t = token.substr(0, pos);
-        weight = atof(token.substr(pos + 1).c_str());
+    boost::string_view symbol;
+    float weight;
+    parseToken(token, symbol, weight, scratch, &h);
+    int32_t wid = counts.insert(symbol, h);
+    if (counts.getType(wid) == entry_type::word) {
+      rslts.LHSTokens.push_back(make_pair(wid, weight));
+    } else {
+      rslts.RHSTokens.push_back(make_pair(wid, weight));
+    }
+  }
+
+  if (args_->ngrams > 1) {
+    static thread_local vector<int64_t> buckets;
+    buckets.clear();
+    ngramBuckets(wordHashes, args_->ngrams, buckets);
+    for (auto bucket : buckets) {
+      rslts.LHSTokens.push_back(make_pair(-(bucket + 1), 1.0));
+    }
+  }
+}
+
+bool DataParser::remap(
+    ParseResults& rslts,
+    const std::vector<int32_t>& toFinal,
+    const Dictionary& dict) {
+
+  const int32_t ngramOffset = dict.nwords() + dict.nlabels();
+  auto remapTokens = [&](vector<Base>& tokens) {
+    size_t kept = 0;
+    for (const auto& token : tokens) {
+      int64_t id;
+      if (token.first >= 0) {
+        id = toFinal[token.first];
+      } else {
+        id = dict.ngramIndex(-(int64_t)token.first - 1);
+        id = (id < 0) ? -1 : ngramOffset + id;
+      }
+      if (id >= 0) {
+        tokens[kept++] = make_pair(id, token.second);
       }
     }
+    tokens.resize(kept);
+  };
+  remapTokens(rslts.LHSTokens);
+  remapTokens(rslts.RHSTokens);
+  return check(rslts);
+}
 
-    if (args_->normalizeText) {
-      normalize_text(t);
+bool DataParser::parse(
+    const std::vector<boost::string_view>& tokens,
+    ParseResults& rslts) {
+
+  auto& wordHashes = scratchWordHashes();
+  wordHashes.clear();
+  string scratch;
+  for (auto token: tokens) {
+    uint32_t h;
+    hashToken(*dict_, token, h, wordHashes);
+    if (token.find("__weight__") != boost::string_view::npos) {
+      std::size_t pos = token.find(args_->weightSep);
+      if (pos != boost::string_view::npos) {
+        rslts.weight =
+          parse_float(token.data() + pos + 1, token.data() + token.size());
+      }
+      continue;
     }
-    int32_t wid = dict_->getId(t);
+    boost::string_view symbol;
+    float weight;
+    parseToken(token, symbol, weight, scratch, &h);
+    int32_t wid = dict_->getId(symbol, h);
     if (wid < 0) {
       continue;
     }
@@ -148,31 +285,26 @@ bool DataParser::parse(
   }
 
   if (args_->ngrams > 1) {
-    addNgrams(tokens, rslts.LHSTokens, args_->ngrams);
+    addNgrams(wordHashes, rslts.LHSTokens, args_->ngrams);
   }
 
   return check(rslts);
 }
 
 bool DataParser::parse(
-    const std::vector<std::string>& tokens,
+    const std::vector<boost::string_view>& tokens,
     vector<Base>& rslts) {
 
-  for (auto &token: tokens) {
-    auto t = token;
-    float weight = 1.0;
-    if (args_->useWeight) {
-      std::size_t pos = token.find(args_->weightSep);
-      if (pos != std::string::npos) {
-        t = token.substr(0, pos);
-        weight = atof(token.substr(pos + 1).c_str());
-      }
-    }
-
-    if (args_->normalizeText) {
-      normalize_text(t);
-    }
-    int32_t wid = dict_->getId(t);
+  auto& wordHashes = scratchWordHashes();
+  wordHashes.clear();
+  string scratch;
+  for (auto token: tokens) {
+    uint32_t h;
+    hashToken(*dict_, token, h, wordHashes);
+    boost::string_view symbol;
+    float weight;
+    parseToken(token, symbol, weight, scratch, &h);
+    int32_t wid = dict_->getId(symbol, h);
     if (wid < 0) {
       continue;
     }
@@ -182,9 +314,21 @@ bool DataParser::parse(
   }
 
   if (args_->ngrams > 1) {
-    addNgrams(tokens, rslts, args_->ngrams);
+    addNgrams(wordHashes, rslts, args_->ngrams);
   }
   return rslts.size() > 0;
 }
 
+size_t BaseVectorHash::operator()(const Base* begin, const Base* end) const {
+  // FNV-1a over the token ids and the bit patterns of their weights.
+  uint64_t h = 14695981039346656037ULL;
+  for (auto t = begin; t != end; t++) {
+    uint32_t w;
+    memcpy(&w, &t->second, sizeof(w));
+    h = (h ^ uint32_t(t->first)) * 1099511628211ULL;
+    h = (h ^ w) * 1099511628211ULL;
+  }
+  return h;
+}
+
 } // namespace starspace
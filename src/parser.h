@@ -10,7 +10,7 @@
  * This is the basic class of data parsing.
  * It provides essential functions as follows:
  * - parse(input, output):
- *   takes input as a line of string (or a vector of string tokens)
+ *   takes input as a line of string (or a vector of tokens viewing it)
  *   and return output result which is one example contains l.h.s. features
  *   and r.h.s. features.
  *
@@ -39,13 +39,34 @@ typedef std::pair<int32_t, float> Base;
 
 struct ParseResults {
   float weight = 1.0;
+  // Index, in its data handler, of the example this one was drawn from,
+  // or -1.
+  int32_t source = -1;
   std::vector<Base> LHSTokens;
   std::vector<Base> RHSTokens;
   std::vector<std::vector<Base>> RHSFeatures;
+
+  // Reset to an empty example, keeping the token buffers.
+  void clear() {
+    weight = 1.0;
+    source = -1;
+    LHSTokens.clear();
+    RHSTokens.clear();
+    RHSFeatures.clear();
+  }
 };
 
 typedef std::vector<ParseResults> Corpus;
 
+// Hash of a list of tokens (ids and weights), used as the query cache key
+// and to find repeated RHS documents.
+struct BaseVectorHash {
+  size_t operator()(const Base* begin, const Base* end) const;
+  size_t operator()(const std::vector<Base>& tokens) const {
+    return (*this)(tokens.data(), tokens.data() + tokens.size());
+  }
+};
+
 class DataParser {
 public:
   explicit DataParser(
@@ -53,35 +74,85 @@ public:
     std::shared_ptr<Args> args);
 
   virtual bool parse(
-      std::string& s,
+      boost::string_view s,
       ParseResults& rslt,
       const std::string& sep="\t ");
 
   virtual void parseForDict(
-      std::string& s,
+      boost::string_view s,
       std::vector<std::string>& tokens,
       const std::string& sep="\t ");
 
   bool parse(
-      const std::vector<std::string>& tokens,
+      const std::vector<boost::string_view>& tokens,
       std::vector<Base>& rslt);
 
   bool parse(
-      const std::vector<std::string>& tokens,
+      const std::vector<boost::string_view>& tokens,
       ParseResults& rslt);
 
   bool check(const ParseResults& example);
 
   void addNgrams(
-      const std::vector<std::string>& tokens,
+      const std::vector<boost::string_view>& tokens,
+      std::vector<Base>& line,
+      int32_t n);
+
+  // Same, given the hashes of the word tokens as collected by hashToken.
+  void addNgrams(
+      const std::vector<int32_t>& wordHashes,
       std::vector<Base>& line,
       int32_t n);
 
+  // Parse a line as parse() does, but insert every token into counts
+  // instead of looking it up in the dictionary. Token ids in rslt are ids
+  // of counts; ngrams are added as -(bucket + 1). remap() turns the result
+  // into a regular example once the dictionary is built.
+  void parseAndCount(
+      boost::string_view s,
+      ParseResults& rslt,
+      Dictionary& counts,
+      const std::string& sep="\t ");
+
+  // Map the ids of an example from parseAndCount through toFinal (-1 for
+  // tokens not kept in dict, the final dictionary), and check that it is
+  // still valid.
+  bool remap(
+      ParseResults& rslt,
+      const std::vector<int32_t>& toFinal,
+      const Dictionary& dict);
+
   std::shared_ptr<Dictionary> getDict() { return dict_; };
 
   void resetDict(std::shared_ptr<Dictionary> dict) { dict_ = dict; };
 
 protected:
+  // Split a token into its symbol and weight, as given by -useWeight, and
+  // normalize the symbol if -normalizeText is set, in which case it points
+  // into scratch. Returns false for tokens to leave out of the dictionary.
+  // If h is given, it holds the hash of token, and is updated to the hash
+  // of symbol; normalization computes it as it goes.
+  bool parseToken(
+      boost::string_view token,
+      boost::string_view& symbol,
+      float& weight,
+      std::string& scratch,
+      uint32_t* h = nullptr) const;
+
+  // Hash a raw token once, for both its dictionary lookup and its ngrams:
+  // h is its hash, also appended to wordHashes if the token is a word.
+  void hashToken(
+      const Dictionary& dict,
+      boost::string_view token,
+      uint32_t& h,
+      std::vector<int32_t>& wordHashes) const;
+
+  // Hashed ngram buckets of the word tokens, in order.
+  void ngramBuckets(
+      const std::vector<int32_t>& wordHashes,
+      int32_t n,
+      std::vector<int64_t>& buckets) const;
+
   std::shared_ptr<Dictionary> dict_;
   std::shared_ptr<Args> args_;
 };
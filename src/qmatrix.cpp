@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "qmatrix.h"
+#include "utils/utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace starspace {
+
+using namespace std;
+
+namespace {
+
+const int kMaxCode = 127;
+
+void swapFloats(vector<float>& v) {
+  for (auto& f : v) {
+    char* p = (char*) &f;
+    std::reverse(p, p + sizeof(float));
+  }
+}
+
+uint64_t tableChecksum(
+    const vector<float>& scales,
+    const vector<int8_t>& codes,
+    int numThreads) {
+  uint64_t a = block_checksum(
+      (const char*) scales.data(), scales.size() * sizeof(float), numThreads);
+  uint64_t b = block_checksum(
+      (const char*) codes.data(), codes.size(), numThreads);
+  return (a * 1099511628211ULL) ^ b;
+}
+
+}
+
+QMatrix::QMatrix(const Matrix<float>& m)
+  : rows_(m.numRows()), cols_(m.numCols()) {
+  scales_.resize(rows_);
+  codes_.resize(rows_ * cols_);
+  for (size_t i = 0; i < rows_; i++) {
+    const float* row = m[i];
+    float maxAbs = 0.0;
+    for (size_t j = 0; j < cols_; j++) {
+      maxAbs = (std::max)(maxAbs, std::fabs(row[j]));
+    }
+    float scale = maxAbs / kMaxCode;
+    scales_[i] = scale;
+    int8_t* code = &codes_[i * cols_];
+    for (size_t j = 0; j < cols_; j++) {
+      code[j] = (scale == 0.0) ? 0 : (int8_t) lrintf(row[j] / scale);
+    }
+  }
+}
+
+void QMatrix::forward(
+    const vector<pair<int32_t, float>>& in,
+    Matrix<float>& mout) const {
+  mout.matrix.resize(1, cols_, false);
+  float* out = mout[0];
+  std::fill(out, out + cols_, 0.0);
+  for (const auto& pair : in) {
+    assert(size_t(pair.first) < rows_);
+    const int8_t* code = codes(pair.first);
+    float w = pair.second * scales_[pair.first];
+    for (size_t j = 0; j < cols_; j++) {
+      out[j] += w * code[j];
+    }
+  }
+}
+
+float QMatrix::dot(const float* q, size_t i) const {
+  const int8_t* code = codes(i);
+  float retval = 0.0;
+  for (size_t j = 0; j < cols_; j++) {
+    retval += q[j] * code[j];
+  }
+  return retval * scales_[i];
+}
+
+float QMatrix::squaredNorm(size_t i) const {
+  const int8_t* code = codes(i);
+  int32_t retval = 0;
+  for (size_t j = 0; j < cols_; j++) {
+    retval += int32_t(code[j]) * code[j];
+  }
+  return retval * scales_[i] * scales_[i];
+}
+
+void QMatrix::save(ostream& out, bool checksum, int numThreads) const {
+  vector<float> scales(scales_);
+  if (!isLittleEndian()) {
+    swapFloats(scales);
+  }
+  uint64_t sum = checksum ? tableChecksum(scales, codes_, numThreads) : 0;
+  out.write((char*) &rows_, sizeof(uint64_t));
+  out.write((char*) &cols_, sizeof(uint64_t));
+  out.write((char*) &sum, sizeof(uint64_t));
+  out.write((char*) scales.data(), scales.size() * sizeof(float));
+  out.write((char*) codes_.data(), codes_.size());
+}
+
+void QMatrix::load(istream& in, bool checksum, int numThreads) {
+  uint64_t sum;
+  in.read((char*) &rows_, sizeof(uint64_t));
+  in.read((char*) &cols_, sizeof(uint64_t));
+  in.read((char*) &sum, sizeof(uint64_t));
+  if (!in) {
+    cerr << "Model file is truncated!" << endl;
+    exit(EXIT_FAILURE);
+  }
+  scales_.resize(rows_);
+  codes_.resize(rows_ * cols_);
+  in.read((char*) scales_.data(), scales_.size() * sizeof(float));
+  in.read((char*) codes_.data(), codes_.size());
+  if (!in) {
+    cerr << "Model file is truncated!" << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (checksum && tableChecksum(scales_, codes_, numThreads) != sum) {
+    cerr << "Model file checksum mismatch! The file may be corrupted." << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!isLittleEndian()) {
+    swapFloats(scales_);
+  }
+}
+
+}
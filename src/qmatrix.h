@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// QMatrix is a read-only, int8 quantized copy of a lookup table, used to
+// serve trained models in about a quarter of the memory.
+
+#pragma once
+
+#include "matrix.h"
+
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace starspace {
+
+/*
+ * Every row is quantized independently: it keeps one float scale and one
+ * int8 code per column, so cell (i, j) is approximately
+ * scale(i) * code(i, j). Queries stay in float and are scored against the
+ * codes directly (asymmetric distance computation); rows are never
+ * dequantized as a whole.
+ */
+class QMatrix {
+public:
+  QMatrix() : rows_(0), cols_(0) {}
+  explicit QMatrix(const Matrix<float>& m);
+
+  size_t numRows() const { return rows_; }
+  size_t numCols() const { return cols_; }
+  // Bytes used by the codes and scales.
+  size_t memoryUsage() const {
+    return codes_.size() * sizeof(int8_t) + scales_.size() * sizeof(float);
+  }
+
+  float scale(size_t i) const { return scales_[i]; }
+  const int8_t* codes(size_t i) const { return &codes_[i * cols_]; }
+
+  // Weighted sum of the given rows, as SparseLinear::forward.
+  void forward(const std::vector<std::pair<int32_t, float>>& in,
+               Matrix<float>& mout) const;
+
+  // Dot product of the float vector q with row i.
+  float dot(const float* q, size_t i) const;
+  float squaredNorm(size_t i) const;
+
+  // Row and column counts, a checksum, the scales as little-endian float32
+  // and then the codes.
+  void save(std::ostream& out, bool checksum, int numThreads) const;
+  void load(std::istream& in, bool checksum, int numThreads);
+
+private:
+  uint64_t rows_;
+  uint64_t cols_;
+  std::vector<float> scales_;
+  std::vector<int8_t> codes_;
+};
+
+}
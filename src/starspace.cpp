@@ -9,7 +9,9 @@
 #include "starspace.h"
 #include <iostream>
 #include <queue>
+#include <cstring>
 #include <unordered_set>
+#include <sys/resource.h>
 
 #include <boost/algorithm/string.hpp>
 
@@ -25,7 +27,12 @@ StarSpace::StarSpace(shared_ptr<Args> args)
   , validData_(nullptr)
   , testData_(nullptr)
   , model_(nullptr)
-  {}
+  , queryCache_(nullptr)
+  {
+    if (args_->queryCacheSize > 0) {
+      queryCache_ = make_shared<QueryCache>(args_->queryCacheSize);
+    }
+  }
 
 void StarSpace::initParser() {
   if (args_->fileFormat == "fastText") {
@@ -76,13 +83,26 @@ void StarSpace::init() {
   initParser();
   dict_ = make_shared<Dictionary>(args_);
   auto filename = args_->trainFile;
-  dict_->readFromFile(filename, parser_);
+  // In single pass mode the examples are parsed while building the dict.
+  bool singlePass = args_->singlePass && args_->fileFormat == "fastText";
+  vector<Corpus> corpora;
+  dict_->readFromFile(filename, parser_, singlePass ? &corpora : nullptr);
   parser_->resetDict(dict_);
   if (args_->debug) {dict_->save(cout);}
 
   // init train data class
   trainData_ = initData();
-  trainData_->loadFromFile(args_->trainFile, parser_);
+  if (singlePass) {
+    trainData_->addCorpora(corpora, filename);
+  } else {
+    trainData_->loadFromFile(args_->trainFile, parser_);
+  }
+  if (args_->trainMode == 5 || args_->trainWord) {
+    trainData_->initWordNegatives(*dict_);
+  }
+  if (args_->trainMode != 5) {
+    trainData_->initRHSNegatives();
+  }
 
   // init model with args and dict
   model_ = make_shared<EmbedModel>(args_, dict_);
@@ -92,6 +112,24 @@ void StarSpace::init() {
     validData_ = initData();
     validData_->loadFromFile(args_->validationFile, parser_);
   }
+  printMemoryUsage();
+}
+
+void StarSpace::printMemoryUsage() const {
+  auto mb = [](size_t bytes) { return bytes / 1048576.0; };
+  size_t examples = trainData_->examplesMemoryUsage();
+  if (validData_ != nullptr) {
+    examples += validData_->examplesMemoryUsage();
+  }
+  cout << "Memory used: examples " << mb(examples) << " MB, dictionary "
+       << mb(dict_->memoryUsage()) << " MB, embeddings "
+       << mb(model_->memoryUsage()) << " MB, negatives table "
+       << mb(trainData_->negativesMemoryUsage()) << " MB.\n";
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    // ru_maxrss is in kilobytes.
+    cout << "Peak resident memory: " << usage.ru_maxrss / 1024.0 << " MB.\n";
+  }
 }
 
 void StarSpace::initFromSavedModel(const string& filename) {
@@ -107,20 +145,45 @@ void StarSpace::initFromSavedModel(const string& filename) {
     magic.push_back(c);
   }
   cout << magic << endl;
-  if (magic != kMagic) {
+  bool binary = (magic == kBinaryMagic);
+  if (!binary && magic != kMagic) {
     std::cerr << "Magic signature does not match!" << std::endl;
     exit(EXIT_FAILURE);
   }
+  uint32_t version = 0;
+  uint32_t flags = 0;
+  if (binary) {
+    in.read((char*) &version, sizeof(uint32_t));
+    if (version > kBinaryVersion) {
+      std::cerr << "Model file format version " << version
+                << " is newer than the supported version " << kBinaryVersion
+                << "!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    in.read((char*) &flags, sizeof(uint32_t));
+  }
   // load args
   args_->load(in);
 
   // init and load dict
   dict_ = make_shared<Dictionary>(args_);
-  dict_->load(in);
+  if (binary && version >= 2) {
+    dict_->loadBinary(in, version >= 4);
+  } else {
+    dict_->load(in);
+  }
 
   // init and load model
-  model_ = make_shared<EmbedModel>(args_, dict_);
-  model_->load(in);
+  model_ = make_shared<EmbedModel>(args_, dict_, false);
+  if (binary) {
+    model_->loadBinary(in, filename, flags & kChecksumFlag,
+                       flags & kQuantizedFlag);
+    if (!args_->pinRows.empty()) {
+      model_->pinRows(args_->pinRows);
+    }
+  } else {
+    model_->load(in);
+  }
   cout << "Model loaded.\n";
 
   // init data parser
@@ -159,6 +222,8 @@ void StarSpace::initFromTsv(const string& filename) {
   // load Model
   model_ = make_shared<EmbedModel>(args_, dict_);
   model_->loadTsv(filename, "\t ");
+  // Cached queries were projected by the previous model.
+  clearQueryCache();
 
   // init data parser
   initParser();
@@ -166,9 +231,30 @@ void StarSpace::initFromTsv(const string& filename) {
 }
 
 void StarSpace::train() {
+  if (model_->isQuantized()) {
+    std::cerr << "A quantized model cannot be trained." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // Cached projections are invalidated by training.
+  clearQueryCache();
+
   float rate = args_->lr;
   float decrPerEpoch = (rate - 1e-9) / args_->epoch;
 
+  // Intermediate models are written in the background while training
+  // continues.
+  Checkpointer checkpointer(
+      model_,
+      [this](const EmbedModel& model, const string& filename) {
+        writeModel(model, filename);
+        writeModelTsv(model, filename + ".tsv");
+      },
+      { ".tsv" },
+      args_->keepCheckpoints);
+  if (args_->saveInterval > 0) {
+    checkpointer.startTimer(args_->saveInterval, args_->model);
+  }
+
   int impatience = 0;
   float best_valid_err = 1e9;
   auto t_start = std::chrono::high_resolution_clock::now();
@@ -178,8 +264,8 @@ void StarSpace::train() {
       if (args_->saveTempModel) {
         filename = filename + "_epoch" + std::to_string(i);
       }
-      saveModel(filename);
-      saveModelTsv(filename + ".tsv");
+      cout << "Saving checkpoint " << filename << endl;
+      checkpointer.save(filename);
     }
     cout << "Training epoch " << i << ": " << rate << ' ' << decrPerEpoch << endl;
     auto err = model_->train(trainData_, args_->thread,
@@ -210,6 +296,29 @@ void StarSpace::train() {
       break;
     }
   }
+  // Write updates back to the model file when it is mapped.
+  checkpointer.finish();
+  model_->sync();
+}
+
+void StarSpace::prune() {
+  if (args_->cutoff <= 0 || model_->isQuantized()) {
+    return;
+  }
+  model_->prune(args_->cutoff);
+  // Loaded examples refer to the ids of the unpruned dictionary.
+  initDataHandler();
+}
+
+void StarSpace::quantize() {
+  auto before = model_->tableMemoryUsage();
+  prune();
+  model_->quantize();
+  cout << "Quantized lookup tables from " << before / 1048576.0 << " MB to "
+       << model_->tableMemoryUsage() / 1048576.0 << " MB.\n";
+  if (!baseDocs_.empty()) {
+    loadBaseDocs();
+  }
 }
 
 void StarSpace::parseDoc(
@@ -217,39 +326,88 @@ void StarSpace::parseDoc(
     vector<Base>& ids,
     const string& sep) {
 
-  vector<string> tokens;
-  boost::split(tokens, line, boost::is_any_of(string(sep)));
+  vector<boost::string_view> tokens;
+  split_tokens(line, sep, tokens);
   parser_->parse(tokens, ids);
 }
 
 Matrix<Real> StarSpace::getDocVector(const string& line, const string& sep) {
   vector<Base> ids;
   parseDoc(line, ids, sep);
-  return model_->projectLHS(ids);
+  if (queryCache_ == nullptr) {
+    return model_->projectLHS(ids);
+  }
+  CachedQuery query;
+  lookupQuery(ids, query);
+  return query.projection;
+}
+
+// Fill query from the cache, projecting and caching it on a miss.
+void StarSpace::lookupQuery(const vector<Base>& ids, CachedQuery& query) {
+  assert(queryCache_ != nullptr);
+  if (!queryCache_->get(ids, query)) {
+    query.projection = model_->projectLHS(ids);
+    query.K = 0;
+    query.topK.clear();
+    queryCache_->put(ids, query);
+  }
+}
+
+uint64_t StarSpace::queryCacheHits() const {
+  return (queryCache_ == nullptr) ? 0 : queryCache_->hits();
+}
+
+uint64_t StarSpace::queryCacheMisses() const {
+  return (queryCache_ == nullptr) ? 0 : queryCache_->misses();
+}
+
+void StarSpace::clearQueryCache() {
+  if (queryCache_ != nullptr) {
+    queryCache_->clear();
+  }
 }
 
 MatrixRow StarSpace::getNgramVector(const string& phrase) {
-  vector<string> tokens;
-  boost::split(tokens, phrase, boost::is_any_of(string(" ")));
+  if (model_->isQuantized()) {
+    std::cerr << "Ngram vectors are not available in a quantized model.\n";
+    exit(EXIT_FAILURE);
+  }
+  vector<boost::string_view> tokens;
+  split_tokens(phrase, " ", tokens);
   if (tokens.size() > (unsigned int)(args_->ngrams)) {
     std::cerr << "Error! Input ngrams size is greater than model ngrams size.\n";
     exit(EXIT_FAILURE);
   }
-  if (tokens.size() == 1) {
-    // looking up the entity embedding directly
-    auto id = dict_->getId(tokens[0]);
-    if (id != -1) {
-      return model_->getLHSEmbeddings()->row(id);
+
+  // Hash every token once; the single-token lookup and the ngram bucket
+  // below both use these, combined the same way as during training.
+  vector<int32_t> hashes;
+  for (auto token: tokens) {
+    uint32_t h = dict_->hash(token);
+    if (tokens.size() == 1) {
+      // looking up the entity embedding directly
+      auto id = dict_->getId(token, h);
+      if (id != -1) {
+        return model_->getLHSEmbeddings()->row(id);
+      }
+    }
+    if (dict_->getType(token) == entry_type::word) {
+      hashes.push_back(h);
     }
   }
 
   uint64_t h = 0;
-  for (auto token: tokens) {
-    if (dict_->getType(token) == entry_type::word) {
-      h = h * Dictionary::HASH_C + dict_->hash(token);
+  if (!hashes.empty()) {
+    h = hashes[0];
+    for (size_t j = 1; j < hashes.size(); j++) {
+      h = h * Dictionary::HASH_C + hashes[j];
     }
   }
-  int64_t id = h % args_->bucket;
+  int64_t id = dict_->ngramIndex(h % args_->bucket);
+  if (id < 0) {
+    std::cerr << "Error! The ngram has been pruned from the model.\n";
+    exit(EXIT_FAILURE);
+  }
   return model_->getLHSEmbeddings()->row(id + dict_->nwords() + dict_->nlabels());
 }
 
@@ -267,7 +425,19 @@ unordered_map<string, float> StarSpace::predictTags(const string& line, int k){
     parseDoc(line, query_vec, " ");
 
     vector<Predictions> predictions;
-    predictOne(query_vec, predictions);
+    if (queryCache_ == nullptr) {
+      predictOne(query_vec, predictions);
+    } else {
+      CachedQuery query;
+      lookupQuery(query_vec, query);
+      if (query.K != k) {
+        query.topK.clear();
+        rankBaseDocs(query.projection, query.topK);
+        query.K = k;
+        queryCache_->put(query_vec, query);
+      }
+      predictions = query.topK;
+    }
 
     unordered_map<string, float> umap;
     
@@ -279,6 +449,11 @@ unordered_map<string, float> StarSpace::predictTags(const string& line, int k){
 }
 
 void StarSpace::loadBaseDocs() {
+  // Cached top K predictions refer to the previous set of base docs.
+  clearQueryCache();
+  baseDocs_.clear();
+  baseDocVectors_.clear();
+
   if (args_->basedoc.empty()) {
     if (args_->fileFormat == "labelDoc") {
       std::cerr << "Must provide base labels when label is featured.\n";
@@ -311,7 +486,7 @@ void StarSpace::loadBaseDocs() {
       std::cerr << "ERROR: basedoc file '" << args_->basedoc << "' is empty." << std::endl;
       exit(EXIT_FAILURE);
     }
-    cout << "Finished loading " << baseDocVectors_.size() << " base docs.\n";
+    cout << "Finished loading " << baseDocVectors_.size() << " base docs." << endl;
   }
 }
 
@@ -319,9 +494,15 @@ void StarSpace::predictOne(
     const vector<Base>& input,
     vector<Predictions>& pred) {
   auto lhsM = model_->projectLHS(input);
+  rankBaseDocs(lhsM, pred);
+}
+
+void StarSpace::rankBaseDocs(
+    const Matrix<Real>& lhsM,
+    vector<Predictions>& pred) {
   std::priority_queue<Predictions> heap;
   for (unsigned int i = 0; i < baseDocVectors_.size(); i++) {
-    auto cur_score = model_->similarity(lhsM, baseDocVectors_[i]);
+    auto cur_score = model_->projectedSimilarity(lhsM, baseDocVectors_[i]);
     heap.push({ cur_score, i });
   }
   // get the first K predictions
@@ -345,7 +526,7 @@ Metrics StarSpace::evaluateOne(
   auto rhsM = model_->projectRHS(rhs);
   // Our evaluation function currently assumes there is only one correct label.
   // TODO: generalize this to the multilabel case.
-  auto score = model_->similarity(lhsM, rhsM);
+  auto score = model_->projectedSimilarity(lhsM, rhsM);
 
   int rank = 1;
   heap.push({ score, 0 });
@@ -356,7 +537,7 @@ Metrics StarSpace::evaluateOne(
     if ((args_->basedoc.empty()) && ((int)i == rhs[0].first - dict_->nwords())) {
       continue;
     }
-    auto cur_score = model_->similarity(lhsM, baseDocVectors_[i]);
+    auto cur_score = model_->projectedSimilarity(lhsM, baseDocVectors_[i]);
     if (cur_score > score) {
       rank++;
     } else if (cur_score == score) {
@@ -407,14 +588,15 @@ void StarSpace::printDoc(ostream& ofs, const vector<Base>& tokens) {
 string StarSpace::printDocStr(const vector<Base>& tokens) {
   for (auto t : tokens) {
     if (t.first < dict_->size()) {
-      return dict_->getSymbol(t.first);
+      auto symbol = dict_->getSymbol(t.first);
+      return string(symbol.data(), symbol.size());
     }
   }
 
   return "__label_unk";
 }
 
-void StarSpace::evaluate() {
+Metrics StarSpace::evaluate() {
   // check that it is not in trainMode 5
   if (args_->trainMode == 5) {
     std::cerr << "Test is undefined in trainMode 5. Please use other trainMode for testing.\n";
@@ -487,28 +669,44 @@ void StarSpace::evaluate() {
     }
     ofs.close();
   }
+  return result;
 }
 
 void StarSpace::saveModel(const string& filename) {
   cout << "Saving model to file : " << filename << endl;
+  writeModel(*model_, filename);
+}
+
+void StarSpace::writeModel(const EmbedModel& model, const string& filename) {
   std::ofstream ofs(filename, std::ofstream::binary);
   if (!ofs.is_open()) {
     std::cerr << "Model file cannot be opened for saving!" << std::endl;
     exit(EXIT_FAILURE);
   }
   // sign model
-  ofs.write(kMagic.data(), kMagic.size() * sizeof(char));
+  ofs.write(kBinaryMagic.data(), kBinaryMagic.size() * sizeof(char));
   ofs.put(0);
+  uint32_t version = kBinaryVersion;
+  uint32_t flags = kChecksumFlag;
+  if (model.isQuantized()) {
+    flags |= kQuantizedFlag;
+  }
+  ofs.write((char*) &version, sizeof(uint32_t));
+  ofs.write((char*) &flags, sizeof(uint32_t));
   args_->save(ofs);
-  dict_->save(ofs);
-  model_->save(ofs);
+  dict_->saveBinary(ofs);
+  model.saveBinary(ofs, flags & kChecksumFlag);
   ofs.close();
 }
 
 void StarSpace::saveModelTsv(const string& filename) {
   cout << "Saving model in tsv format : " << filename << endl;
+  writeModelTsv(*model_, filename);
+}
+
+void StarSpace::writeModelTsv(const EmbedModel& model, const string& filename) {
   ofstream fout(filename);
-  model_->saveTsv(fout, '\t');
+  model.saveTsv(fout, '\t');
   fout.close();
 }
 
@@ -13,12 +13,24 @@
 #include "parser.h"
 #include "doc_parser.h"
 #include "model.h"
+#include "checkpointer.h"
 #include "utils/utils.h"
+#include "utils/lru_cache.h"
 
 namespace starspace {
 
 typedef std::pair<Real, int32_t> Predictions;
 
+// What the query cache remembers about a parsed query: its LHS projection
+// and, once predictTags has been called on it, its top K predictions.
+struct CachedQuery {
+  Matrix<Real> projection;
+  int K = 0;
+  std::vector<Predictions> topK;
+};
+
+typedef LRUCache<std::vector<Base>, CachedQuery, BaseVectorHash> QueryCache;
+
 class StarSpace {
   public:
     explicit StarSpace(std::shared_ptr<Args> args);
@@ -28,7 +40,14 @@ class StarSpace {
     void initFromSavedModel(const std::string& filename);
 
     void train();
-    void evaluate();
+    Metrics evaluate();
+    // If -cutoff is set, keep only the -cutoff most frequent words and
+    // the ngram buckets updated in training (see EmbedModel::prune).
+    void prune();
+    // Quantize the lookup tables to int8 (see QMatrix), after pruning the
+    // model if -cutoff is set. Base docs are projected again with the
+    // quantized model.
+    void quantize();
 
     MatrixRow getNgramVector(const std::string& phrase);
     Matrix<Real> getDocVector(
@@ -49,7 +68,17 @@ class StarSpace {
     void saveModelTsv(const std::string& filename);
     void printDoc(std::ostream& ofs, const std::vector<Base>& tokens);
 
+    // Signature of models whose embeddings are serialized as ublas text.
     const std::string kMagic = "STARSPACE-2018-2";
+    // Signature of models written in the binary format, followed by a
+    // format version and a set of flags. Version 2 stores the dictionary
+    // together with its hash table; version 3 adds quantized models, whose
+    // lookup tables are stored as QMatrix, and version 4 the ngram bucket
+    // remap of pruned dictionaries.
+    const std::string kBinaryMagic = "STARSPACE-BIN";
+    static const uint32_t kBinaryVersion = 4;
+    static const uint32_t kChecksumFlag = 1;
+    static const uint32_t kQuantizedFlag = 2;
 
 
     void loadBaseDocs();
@@ -58,12 +87,25 @@ class StarSpace {
         const std::vector<Base>& input,
         std::vector<Predictions>& pred);
 
+    uint64_t queryCacheHits() const;
+    uint64_t queryCacheMisses() const;
+    void clearQueryCache();
+
     std::shared_ptr<Args> args_;
     std::vector<std::vector<Base>> baseDocs_;
   private:
+    void writeModel(const EmbedModel& model, const std::string& filename);
+    void writeModelTsv(const EmbedModel& model, const std::string& filename);
     void initParser();
     void initDataHandler();
     std::shared_ptr<InternDataHandler> initData();
+    // Print the bytes held by the training data, the dictionary and the
+    // model, and the peak resident memory of the process.
+    void printMemoryUsage() const;
+    void rankBaseDocs(
+        const Matrix<Real>& lhsM,
+        std::vector<Predictions>& pred);
+    void lookupQuery(const std::vector<Base>& ids, CachedQuery& query);
     Metrics evaluateOne(
         const std::vector<Base>& lhs,
         const std::vector<Base>& rhs,
@@ -78,6 +120,7 @@ class StarSpace {
     std::shared_ptr<EmbedModel> model_;
 
     std::vector<Matrix<Real>> baseDocVectors_;
+    std::shared_ptr<QueryCache> queryCache_;
 };
 
 }
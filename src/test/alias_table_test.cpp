@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../utils/alias_table.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace std;
+using namespace starspace;
+
+TEST(AliasTable, followsWeights) {
+  vector<double> weights = { 5.0, 0.0, 1.0, 2.5, 0.5, 1.0 };
+  double sum = 10.0;
+  AliasTable table(weights);
+  ASSERT_EQ(table.size(), weights.size());
+
+  const int kSamples = 1000000;
+  vector<int> counts(weights.size(), 0);
+  mt19937_64 rng(1);
+  for (int i = 0; i < kSamples; i++) {
+    counts[table.sample(rng())]++;
+  }
+  EXPECT_EQ(counts[1], 0);
+  for (size_t i = 0; i < weights.size(); i++) {
+    EXPECT_NEAR(double(counts[i]) / kSamples, weights[i] / sum, 0.003);
+  }
+}
+
+TEST(AliasTable, singleOutcome) {
+  AliasTable table({ 3.0 });
+  EXPECT_EQ(table.sample(0), 0);
+  EXPECT_EQ(table.sample(~uint64_t(0)), 0);
+}
+
+TEST(AliasTable, sampleOnManyThreads) {
+  AliasTable table({ 1.0, 2.0, 3.0, 4.0 });
+  vector<vector<int>> counts(4, vector<int>(4, 0));
+  vector<thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 100000; i++) {
+        counts[t][table.sample()]++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int t = 0; t < 4; t++) {
+    for (int i = 0; i < 4; i++) {
+      EXPECT_NEAR(counts[t][i] / 100000.0, (i + 1) / 10.0, 0.01);
+    }
+  }
+}
@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../utils/compressed.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef COMPRESS_FILE
+#include <zlib.h>
+#endif
+
+using namespace std;
+using namespace starspace;
+
+TEST(Compressed, inputFiles) {
+  EXPECT_EQ(gz_input_files("in", 3),
+            vector<string>({ "in00.gz", "in01.gz", "in02.gz" }));
+  EXPECT_EQ(gz_input_files("day.txt.gz", 3), vector<string>({ "day.txt.gz" }));
+
+  char dir[] = "/tmp/compressed_testXXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  string d(dir);
+  for (string name : { "b.gz", "a.gz", "c.txt" }) {
+    ofstream(d + "/" + name) << "x";
+  }
+  EXPECT_EQ(gz_input_files(d + "/*.gz", 1),
+            vector<string>({ d + "/a.gz", d + "/b.gz" }));
+  ofstream(d + "/list") << d + "/c.txt\n\n" << d + "/a.gz  \n";
+  EXPECT_EQ(gz_input_files("@" + d + "/list", 1),
+            vector<string>({ d + "/c.txt", d + "/a.gz" }));
+  for (string name : { "b.gz", "a.gz", "c.txt", "list" }) {
+    remove((d + "/" + name).c_str());
+  }
+  rmdir(dir);
+}
+
+#ifdef COMPRESS_FILE
+
+namespace {
+
+string deflateRaw(const string& data) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  string out(deflateBound(&zs, data.size()), 0);
+  zs.next_in = (Bytef*)data.data();
+  zs.avail_in = data.size();
+  zs.next_out = (Bytef*)&out[0];
+  zs.avail_out = out.size();
+  deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+void putLE(string& s, uint32_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    s.push_back(char((v >> (8 * i)) & 0xff));
+  }
+}
+
+// A BGZF member holding data, as bgzip writes them.
+string bgzfBlock(const string& data) {
+  string cdata = deflateRaw(data);
+  string block = string("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+  putLE(block, 18 + cdata.size() + 8 - 1, 2);
+  block += cdata;
+  putLE(block, crc32(0, (const Bytef*)data.data(), data.size()), 4);
+  putLE(block, data.size(), 4);
+  return block;
+}
+
+vector<string> readAll(const vector<string>& files, int numThreads) {
+  mutex m;
+  vector<string> lines;
+  EXPECT_TRUE(read_gz_lines(files, [&](int i, boost::string_view line) {
+    EXPECT_LT(i, numThreads);
+    lock_guard<mutex> lock(m);
+    lines.push_back(line.to_string());
+  }, numThreads));
+  sort(lines.begin(), lines.end());
+  return lines;
+}
+
+}
+
+TEST(Compressed, readGzipAndBgzf) {
+  vector<string> lines;
+  string text;
+  for (int i = 0; i < 5000; i++) {
+    lines.push_back("line " + to_string(i) + string(i % 50, 'x'));
+    text += lines.back() + "\n";
+  }
+  // No newline after the last line.
+  text.pop_back();
+  sort(lines.begin(), lines.end());
+
+  char dir[] = "/tmp/compressed_testXXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  string d(dir);
+
+  // A regular gzip file, written as two members.
+  string gz = d + "/plain.gz";
+  size_t half = text.size() / 2;
+  for (auto part : { text.substr(0, half), text.substr(half) }) {
+    gzFile out = gzopen(gz.c_str(), "ab");
+    gzwrite(out, part.data(), part.size());
+    gzclose(out);
+  }
+
+  // A BGZF file whose blocks cut lines anywhere, with empty blocks and
+  // the empty end of file block.
+  string bgzf = d + "/blocks.gz";
+  {
+    ofstream out(bgzf, ofstream::binary);
+    for (size_t pos = 0; pos < text.size(); pos += 3001) {
+      out << bgzfBlock(text.substr(pos, 3001));
+      if (pos % 7 == 0) {
+        out << bgzfBlock("");
+      }
+    }
+    out << bgzfBlock("");
+  }
+
+  for (int numThreads : { 1, 3, 8 }) {
+    EXPECT_EQ(readAll({ gz }, numThreads), lines);
+    EXPECT_EQ(readAll({ bgzf }, numThreads), lines);
+  }
+
+  // Two files on one or two threads: each file is read by one thread.
+  auto twice = lines;
+  twice.insert(twice.end(), lines.begin(), lines.end());
+  sort(twice.begin(), twice.end());
+  EXPECT_EQ(readAll({ gz, bgzf }, 1), twice);
+  EXPECT_EQ(readAll({ gz, bgzf }, 2), twice);
+
+  remove(gz.c_str());
+  remove(bgzf.c_str());
+  rmdir(dir);
+}
+
+#endif
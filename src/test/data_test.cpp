@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../data.h"
+#include <gtest/gtest.h>
+#include <map>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+ParseResults example(vector<int32_t> lhs, vector<int32_t> rhs) {
+  ParseResults ex;
+  for (auto id : lhs) {
+    ex.LHSTokens.emplace_back(id, 1.0);
+  }
+  for (auto id : rhs) {
+    ex.RHSTokens.emplace_back(id, 1.0);
+  }
+  return ex;
+}
+
+// Frequencies of the RHS negatives drawn from data.
+map<vector<int32_t>, double> sampleRHS(const InternDataHandler& data) {
+  const int kSamples = 200000;
+  map<vector<int32_t>, double> freqs;
+  vector<Base> rhs;
+  for (int i = 0; i < kSamples; i++) {
+    data.getRandomRHS(rhs);
+    vector<int32_t> ids;
+    for (const auto& t : rhs) {
+      ids.push_back(t.first);
+    }
+    freqs[ids] += 1.0 / kSamples;
+  }
+  return freqs;
+}
+
+}
+
+TEST(InternDataHandler, addCorporaMovesExamples) {
+  auto args = make_shared<Args>();
+  InternDataHandler data(args);
+  vector<Corpus> corpora(3);
+  corpora[0].push_back(example({ 1 }, { 10 }));
+  corpora[2].push_back(example({ 2, 3 }, { 11 }));
+  corpora[2].push_back(example({ 4 }, { 10, 12 }));
+  data.addCorpora(corpora, "test");
+  EXPECT_EQ(data.getSize(), 3);
+  for (const auto& corpus : corpora) {
+    EXPECT_EQ(corpus.capacity(), 0);
+  }
+  ParseResults ex;
+  data.getExampleById(1, ex);
+  EXPECT_EQ(ex.LHSTokens, example({ 2, 3 }, {}).LHSTokens);
+}
+
+TEST(InternDataHandler, rhsNegativesFollowExamples) {
+  auto args = make_shared<Args>();
+  InternDataHandler data(args);
+  vector<Corpus> corpora(1);
+  // Labels 10 and 11 each have one and a half examples, 12 has one.
+  corpora[0].push_back(example({ 1 }, { 10 }));
+  corpora[0].push_back(example({ 2 }, { 10, 11 }));
+  corpora[0].push_back(example({ 3 }, { 12 }));
+  corpora[0].push_back(example({ 3 }, { 11 }));
+  data.addCorpora(corpora, "test");
+  data.initRHSNegatives();
+  auto freqs = sampleRHS(data);
+  ASSERT_EQ(freqs.size(), 3);
+  EXPECT_NEAR(freqs[{ 10 }], 1.5 / 4, 0.01);
+  EXPECT_NEAR(freqs[{ 11 }], 1.5 / 4, 0.01);
+  EXPECT_NEAR(freqs[{ 12 }], 1.0 / 4, 0.01);
+
+  // With a power of 0, every label is as likely.
+  args->labelNegPower = 0.0;
+  data.initRHSNegatives();
+  freqs = sampleRHS(data);
+  EXPECT_NEAR(freqs[{ 10 }], 1.0 / 3, 0.01);
+  EXPECT_NEAR(freqs[{ 12 }], 1.0 / 3, 0.01);
+
+  // With trainMode 2, all labels but one are drawn together.
+  args->labelNegPower = 1.0;
+  args->trainMode = 2;
+  data.initRHSNegatives();
+  freqs = sampleRHS(data);
+  EXPECT_NEAR((freqs[{ 10 }]), 0.5 / 4, 0.01);
+  EXPECT_NEAR((freqs[{ 11 }]), 0.5 / 4, 0.01);
+  EXPECT_NEAR((freqs[{}]), 3.0 / 4, 0.01);
+}
+
+TEST(InternDataHandler, rhsCandidatesAreBuiltFromExamples) {
+  auto args = make_shared<Args>();
+  args->trainMode = 2;
+  InternDataHandler data(args);
+  vector<Corpus> corpora(1);
+  corpora[0].push_back(example({ 1 }, { 10, 11, 12 }));
+  corpora[0].push_back(example({ 2 }, { 10, 11, 12 }));
+  corpora[0].push_back(example({ 3 }, { 10, 12, 13 }));
+  data.addCorpora(corpora, "test");
+  data.initRHSNegatives();
+  // The two first examples have the same candidates, and the last one
+  // shares { 10, 12 } with them.
+  ASSERT_EQ(data.numRHSCandidates(), 5);
+  vector<vector<int32_t>> candidates;
+  vector<Base> candidate;
+  for (size_t i = 0; i < data.numRHSCandidates(); i++) {
+    data.getRHSCandidate(i, candidate);
+    vector<int32_t> ids;
+    for (const auto& t : candidate) {
+      ids.push_back(t.first);
+    }
+    candidates.push_back(ids);
+  }
+  vector<vector<int32_t>> expected{
+    { 11, 12 }, { 10, 12 }, { 10, 11 }, { 12, 13 }, { 10, 13 } };
+  EXPECT_EQ(candidates, expected);
+}
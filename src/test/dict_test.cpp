@@ -0,0 +1,311 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../dict.h"
+#include "../parser.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+using namespace starspace;
+
+TEST(Dictionary, insertAndFind) {
+  Dictionary dict(make_shared<Args>());
+  dict.insert("apple");
+  dict.insert("__label__fruit");
+  dict.insert("apple");
+  EXPECT_EQ(dict.size(), 2);
+  EXPECT_EQ(dict.ntokens(), 3);
+  EXPECT_EQ(dict.getId("apple"), 0);
+  EXPECT_EQ(dict.getId("__label__fruit"), 1);
+  EXPECT_EQ(dict.getId("pear"), -1);
+  EXPECT_EQ(dict.getType(1), entry_type::label);
+}
+
+TEST(Dictionary, grows) {
+  Dictionary dict(make_shared<Args>());
+  const int n = 20000;
+  for (int i = 0; i < n; i++) {
+    dict.insert("w" + to_string(i));
+  }
+  EXPECT_EQ(dict.size(), n);
+  for (int i = 0; i < n; i++) {
+    EXPECT_EQ(dict.getId("w" + to_string(i)), i);
+  }
+}
+
+TEST(Dictionary, threshold) {
+  Dictionary dict(make_shared<Args>());
+  for (int i = 0; i < 3; i++) dict.insert("frequent");
+  dict.insert("rare");
+  for (int i = 0; i < 2; i++) dict.insert("__label__a");
+  dict.threshold(2, 1);
+  EXPECT_EQ(dict.nwords(), 1);
+  EXPECT_EQ(dict.nlabels(), 1);
+  EXPECT_EQ(dict.getId("frequent"), 0);
+  EXPECT_EQ(dict.getId("__label__a"), 1);
+  EXPECT_EQ(dict.getId("rare"), -1);
+}
+
+TEST(Dictionary, saveLoad) {
+  auto args = make_shared<Args>();
+  Dictionary dict(args);
+  for (int i = 0; i < 3000; i++) {
+    dict.insert("w" + to_string(i % 1500));
+  }
+  dict.insert("__label__x");
+  dict.threshold(1, 1);
+
+  for (int binary = 0; binary < 2; binary++) {
+    stringstream ss;
+    if (binary) {
+      dict.saveBinary(ss);
+    } else {
+      dict.save(ss);
+    }
+    Dictionary loaded(args);
+    if (binary) {
+      loaded.loadBinary(ss);
+    } else {
+      loaded.load(ss);
+    }
+    EXPECT_EQ(loaded.size(), dict.size());
+    EXPECT_EQ(loaded.nwords(), dict.nwords());
+    EXPECT_EQ(loaded.nlabels(), dict.nlabels());
+    EXPECT_EQ(loaded.ntokens(), dict.ntokens());
+    for (int32_t i = 0; i < dict.size(); i++) {
+      EXPECT_EQ(loaded.getSymbol(i), dict.getSymbol(i));
+      EXPECT_EQ(loaded.getId(dict.getSymbol(i)), i);
+    }
+    EXPECT_EQ(loaded.getId("unknown"), -1);
+  }
+}
+
+TEST(Dictionary, prune) {
+  auto args = make_shared<Args>();
+  args->ngrams = 2;
+  args->bucket = 100;
+  Dictionary dict(args);
+  for (int i = 0; i < 3; i++) dict.insert("a");
+  for (int i = 0; i < 2; i++) dict.insert("b");
+  dict.insert("c");
+  dict.insert("__label__x");
+  dict.threshold(1, 1);
+  EXPECT_FALSE(dict.isPruned());
+  EXPECT_EQ(dict.nbuckets(), 100);
+  EXPECT_EQ(dict.ngramIndex(42), 42);
+
+  dict.prune({0, 2}, {7, 42});
+  EXPECT_TRUE(dict.isPruned());
+  EXPECT_EQ(dict.nwords(), 2);
+  EXPECT_EQ(dict.nlabels(), 1);
+  EXPECT_EQ(dict.getId("a"), 0);
+  EXPECT_EQ(dict.getId("b"), -1);
+  EXPECT_EQ(dict.getId("c"), 1);
+  EXPECT_EQ(dict.getLabel(0), "__label__x");
+  EXPECT_EQ(dict.nbuckets(), 2);
+  EXPECT_EQ(dict.ngramIndex(7), 0);
+  EXPECT_EQ(dict.ngramIndex(42), 1);
+  EXPECT_EQ(dict.ngramIndex(8), -1);
+
+  stringstream ss;
+  dict.saveBinary(ss);
+  Dictionary loaded(args);
+  loaded.loadBinary(ss);
+  EXPECT_EQ(loaded.nwords(), 2);
+  EXPECT_EQ(loaded.nbuckets(), 2);
+  EXPECT_EQ(loaded.ngramIndex(42), 1);
+  EXPECT_EQ(loaded.ngramIndex(8), -1);
+}
+
+TEST(Dictionary, readFromFileOnManyThreads) {
+  char path[] = "/tmp/dict_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    ofstream out(path);
+    for (int i = 0; i < 500; i++) {
+      out << "w" << i % 37 << " w" << i % 11 << " __label__" << i % 5 << "\n";
+    }
+    // No newline after the last line.
+    out << "last __label__0";
+  }
+
+  vector<shared_ptr<Dictionary>> dicts;
+  for (int thread : {1, 4}) {
+    auto args = make_shared<Args>();
+    args->thread = thread;
+    auto dict = make_shared<Dictionary>(args);
+    auto parser = make_shared<DataParser>(dict, args);
+    dict->readFromFile(path, parser);
+    dicts.push_back(dict);
+  }
+  remove(path);
+
+  EXPECT_EQ(dicts[0]->ntokens(), 1502);
+  EXPECT_EQ(dicts[0]->nwords(), 38);
+  EXPECT_EQ(dicts[0]->nlabels(), 5);
+  EXPECT_EQ(dicts[1]->ntokens(), dicts[0]->ntokens());
+  ASSERT_EQ(dicts[1]->size(), dicts[0]->size());
+  for (int32_t i = 0; i < dicts[0]->size(); i++) {
+    EXPECT_EQ(dicts[1]->getSymbol(i), dicts[0]->getSymbol(i));
+    EXPECT_EQ(dicts[1]->getCount(i), dicts[0]->getCount(i));
+  }
+}
+
+TEST(Dictionary, readFromFileParsesExamplesInOnePass) {
+  char path[] = "/tmp/dict_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  vector<string> lines;
+  for (int i = 0; i < 200; i++) {
+    lines.push_back("w" + to_string(i % 13) + " w" + to_string(i % 50) +
+                    " w" + to_string(i % 3) + " __label__" + to_string(i % 7));
+  }
+  lines.push_back("rare __label__rare");
+  {
+    ofstream out(path);
+    for (const auto& line : lines) {
+      out << line << "\n";
+    }
+  }
+
+  auto args = make_shared<Args>();
+  args->thread = 1;
+  args->ngrams = 2;
+  args->bucket = 1000;
+  args->minCount = 5;
+  args->minCountLabel = 2;
+
+  // Two passes: build the dictionary, then parse every line against it.
+  auto dict = make_shared<Dictionary>(args);
+  auto parser = make_shared<DataParser>(dict, args);
+  dict->readFromFile(path, parser);
+  vector<ParseResults> expected;
+  for (auto line : lines) {
+    ParseResults example;
+    if (parser->parse(line, example)) {
+      expected.push_back(example);
+    }
+  }
+
+  auto onePassDict = make_shared<Dictionary>(args);
+  auto onePassParser = make_shared<DataParser>(onePassDict, args);
+  vector<Corpus> corpora;
+  onePassDict->readFromFile(path, onePassParser, &corpora);
+  remove(path);
+
+  ASSERT_EQ(onePassDict->size(), dict->size());
+  ASSERT_EQ(corpora.size(), 1);
+  const auto& corpus = corpora[0];
+  ASSERT_EQ(corpus.size(), expected.size());
+  for (size_t i = 0; i < corpus.size(); i++) {
+    EXPECT_EQ(corpus[i].LHSTokens, expected[i].LHSTokens);
+    EXPECT_EQ(corpus[i].RHSTokens, expected[i].RHSTokens);
+    EXPECT_EQ(corpus[i].weight, expected[i].weight);
+  }
+}
+
+TEST(Dictionary, readFromFileWithinBudget) {
+  char path[] = "/tmp/dict_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    // A few frequent words among many that are seen once.
+    ofstream out(path);
+    for (int i = 0; i < 3000; i++) {
+      out << "w" << i % 10 << " rare" << i << " w" << i % 7
+          << " __label__" << i % 3 << "\n";
+    }
+  }
+
+  vector<shared_ptr<Dictionary>> dicts;
+  for (int budget : {0, 64}) {
+    for (int thread : {1, 2}) {
+      auto args = make_shared<Args>();
+      args->thread = thread;
+      args->minCount = 5;
+      args->dictBudget = budget;
+      auto dict = make_shared<Dictionary>(args);
+      auto parser = make_shared<DataParser>(dict, args);
+      dict->readFromFile(path, parser);
+      dicts.push_back(dict);
+    }
+  }
+  remove(path);
+
+  const auto& expected = *dicts[0];
+  EXPECT_EQ(expected.nwords(), 10);
+  EXPECT_EQ(expected.nlabels(), 3);
+  for (size_t d = 1; d < dicts.size(); d++) {
+    EXPECT_EQ(dicts[d]->ntokens(), expected.ntokens());
+    ASSERT_EQ(dicts[d]->size(), expected.size());
+    for (int32_t i = 0; i < expected.size(); i++) {
+      int32_t id = dicts[d]->getId(expected.getSymbol(i));
+      ASSERT_GE(id, 0);
+      EXPECT_EQ(dicts[d]->getCount(id), expected.getCount(i));
+    }
+  }
+}
+
+TEST(Dictionary, readFromFileThresholdsMergedCounts) {
+  char path[] = "/tmp/dict_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    // 600 words, each seen 8 times, and spread over every part of the file.
+    ofstream out(path);
+    for (int i = 0; i < 2400; i++) {
+      out << "w" << i % 600 << " w" << (i * 7 + 3) % 600
+          << " __label__" << i % 3 << "\n";
+    }
+  }
+
+  // limit: the merged dictionary fits, though each of the 8 shards holds
+  // more than limit / 8 symbols; then it does not fit.
+  for (int64_t limit : {1000, 400}) {
+    vector<shared_ptr<Dictionary>> dicts;
+    for (int thread : {1, 8}) {
+      auto args = make_shared<Args>();
+      args->thread = thread;
+      auto dict = make_shared<Dictionary>(args);
+      dict->setVocabLimit(limit);
+      auto parser = make_shared<DataParser>(dict, args);
+      dict->readFromFile(path, parser);
+      dicts.push_back(dict);
+    }
+    for (const auto& dict : dicts) {
+      EXPECT_LE(dict->size(), limit);
+      EXPECT_EQ(dict->nlabels(), 3);
+    }
+    if (limit == 1000) {
+      EXPECT_EQ(dicts[0]->nwords(), 600);
+      ASSERT_EQ(dicts[1]->size(), dicts[0]->size());
+      for (int32_t i = 0; i < dicts[0]->size(); i++) {
+        EXPECT_EQ(dicts[1]->getSymbol(i), dicts[0]->getSymbol(i));
+        EXPECT_EQ(dicts[1]->getCount(i), dicts[0]->getCount(i));
+      }
+    }
+  }
+  remove(path);
+}
+
+/**
+* @brief  Main entry-point for this application, for the case of
+*  running this test project standalone.
+*/
+int main(int argc, char* argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
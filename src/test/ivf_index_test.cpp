@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../ivf_index.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+const size_t kDim = 16;
+
+float dot(const float* a, const float* b) {
+  float s = 0.0;
+  for (size_t i = 0; i < kDim; i++) {
+    s += a[i] * b[i];
+  }
+  return s;
+}
+
+// The k vectors of largest inner product with query, best first.
+vector<int32_t> exactSearch(
+    const vector<float>& vectors, const float* query, size_t k) {
+  vector<pair<float, int32_t>> scores;
+  for (size_t i = 0; i < vectors.size() / kDim; i++) {
+    scores.emplace_back(dot(&vectors[i * kDim], query), i);
+  }
+  sort(scores.rbegin(), scores.rend());
+  vector<int32_t> ids;
+  for (size_t i = 0; i < k; i++) {
+    ids.push_back(scores[i].second);
+  }
+  return ids;
+}
+
+}
+
+TEST(IVFIndex, search) {
+  // Points scattered around 20 random centers.
+  minstd_rand rng(3);
+  normal_distribution<float> normal(0.0, 1.0);
+  vector<float> centers(20 * kDim);
+  for (auto& c : centers) {
+    c = normal(rng);
+  }
+  vector<float> vectors;
+  for (int i = 0; i < 2000; i++) {
+    const float* center = &centers[(i % 20) * kDim];
+    for (size_t j = 0; j < kDim; j++) {
+      vectors.push_back(center[j] + 0.3 * normal(rng));
+    }
+  }
+
+  IVFIndex index(vectors, kDim, 40);
+  EXPECT_EQ(index.size(), 2000);
+  EXPECT_EQ(index.numLists(), 40);
+
+  size_t found = 0;
+  for (int q = 0; q < 50; q++) {
+    const float* query = &vectors[q * 37 * kDim];
+    auto expected = exactSearch(vectors, query, 10);
+    vector<int32_t> ids;
+    // Probing every list is exact.
+    index.search(query, 10, index.numLists(), ids);
+    EXPECT_EQ(ids, expected);
+
+    index.search(query, 10, 4, ids);
+    ASSERT_EQ(ids.size(), 10);
+    for (auto id : ids) {
+      found += count(expected.begin(), expected.end(), id);
+    }
+  }
+  EXPECT_GT(found, 0.8 * 50 * 10);
+}
+
+TEST(IVFIndex, fewVectors) {
+  vector<float> vectors(3 * kDim, 0.0);
+  vectors[0] = 1.0;
+  vectors[kDim + 1] = 2.0;
+  vectors[2 * kDim] = -1.0;
+  IVFIndex index(vectors, kDim, 10);
+  EXPECT_EQ(index.numLists(), 3);
+  vector<int32_t> ids;
+  index.search(&vectors[0], 5, 3, ids);
+  EXPECT_EQ(ids.size(), 3);
+  EXPECT_EQ(ids[0], 0);
+  EXPECT_EQ(ids[2], 2);
+}
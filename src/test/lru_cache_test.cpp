@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../utils/lru_cache.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace starspace;
+
+TEST(LRUCache, hitAndMiss) {
+  LRUCache<int, string> cache(4, 1);
+  string v;
+  EXPECT_FALSE(cache.get(1, v));
+  cache.put(1, "one");
+  EXPECT_TRUE(cache.get(1, v));
+  EXPECT_EQ(v, "one");
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+}
+
+TEST(LRUCache, evictsLeastRecentlyUsed) {
+  LRUCache<int, int> cache(3, 1);
+  cache.put(1, 10);
+  cache.put(2, 20);
+  cache.put(3, 30);
+  int v;
+  // Touch 1 so that 2 becomes the least recently used entry.
+  EXPECT_TRUE(cache.get(1, v));
+  cache.put(4, 40);
+  EXPECT_EQ(cache.size(), 3);
+  EXPECT_FALSE(cache.get(2, v));
+  EXPECT_TRUE(cache.get(1, v));
+  EXPECT_EQ(v, 10);
+  EXPECT_TRUE(cache.get(4, v));
+  EXPECT_EQ(v, 40);
+}
+
+TEST(LRUCache, overwriteAndClear) {
+  LRUCache<int, int> cache(8);
+  cache.put(7, 1);
+  cache.put(7, 2);
+  int v;
+  EXPECT_TRUE(cache.get(7, v));
+  EXPECT_EQ(v, 2);
+  EXPECT_EQ(cache.size(), 1);
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_FALSE(cache.get(7, v));
+}
+
+TEST(LRUCache, concurrentAccess) {
+  LRUCache<int, int> cache(64, 8);
+  vector<thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&cache, t] {
+      for (int i = 0; i < 1000; i++) {
+        int k = (i * 7 + t) % 100;
+        int v;
+        if (cache.get(k, v)) {
+          EXPECT_EQ(v, k * 2);
+        } else {
+          cache.put(k, k * 2);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  EXPECT_EQ(cache.hits() + cache.misses(), 4000);
+  EXPECT_LE(cache.size(), 64);
+}
+
+/**
+* @brief  Main entry-point for this application, for the case of
+*  running this test project standalone.
+*/
+int main(int argc, char* argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,6 +8,9 @@
 #include <gtest/gtest.h>
 #include "../matrix.h"
 
+#include <cstdio>
+#include <cstring>
+
 using namespace starspace;
 
 TEST(Matrix, init) {
@@ -81,6 +84,60 @@ TEST(Matrix, mulRand) {
   });
 }
 
+#ifndef _WIN32
+TEST(Matrix, mappedFromFile) {
+  char path[] = "/tmp/matrix_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  // Cells start past a header, at an offset that is not page aligned.
+  const size_t offset = 64;
+  std::vector<float> cells{ 1.0, 2.0, 3.0, 4.0, 5.0, 6.0 };
+  std::vector<char> file(offset + cells.size() * sizeof(float), 0);
+  memcpy(file.data() + offset, cells.data(), cells.size() * sizeof(float));
+  ASSERT_EQ(write(fd, file.data(), file.size()), (ssize_t)file.size());
+
+  auto readCell = [&](size_t i) {
+    float cell;
+    FILE* f = fopen(path, "rb");
+    EXPECT_NE(f, nullptr);
+    fseek(f, offset + i * sizeof(float), SEEK_SET);
+    EXPECT_EQ(fread(&cell, sizeof(float), 1, f), 1u);
+    fclose(f);
+    return cell;
+  };
+
+  {
+    // Private writable mappings leave the file unchanged.
+    Matrix<float> mtx;
+    ASSERT_TRUE(mtx.matrix.data().map(fd, offset, cells.size(), true));
+    mtx.matrix.resize(2, 3, false);
+    mtx[0][2] = 8.0;
+    EXPECT_FLOAT_EQ(mtx[0][2], 8.0);
+  }
+  EXPECT_FLOAT_EQ(readCell(2), 3.0);
+
+  {
+    Matrix<float> mtx;
+    ASSERT_TRUE(mtx.matrix.data().map(fd, offset, cells.size(), true, true));
+    mtx.matrix.resize(2, 3, false);
+    EXPECT_TRUE(mtx.matrix.data().isMapped());
+    EXPECT_FLOAT_EQ(mtx[1][0], 4.0);
+    mtx[0][2] = 7.0;
+    EXPECT_TRUE(mtx.matrix.data().sync());
+
+    // Copies own their cells.
+    Matrix<float> copy(mtx);
+    EXPECT_FALSE(copy.matrix.data().isMapped());
+    copy[0][0] = 9.0;
+    EXPECT_FLOAT_EQ(mtx[0][0], 1.0);
+  }
+  close(fd);
+
+  EXPECT_FLOAT_EQ(readCell(2), 7.0);
+  unlink(path);
+}
+#endif
+
 /**
 * @brief  Main entry-point for this application, for the case of
 *  running this test project standalone.
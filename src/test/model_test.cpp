@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../model.h"
+#include "../parser.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <sstream>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+// A model over the words a and b and the labels w, x, y and z.
+struct Fixture {
+  shared_ptr<Args> args = make_shared<Args>();
+  shared_ptr<Dictionary> dict;
+
+  Fixture() {
+    args->dim = 8;
+    args->hardNegatives = 10;
+    dict = make_shared<Dictionary>(args);
+    for (auto symbol : { "a", "b", "__label__w", "__label__x", "__label__y",
+                         "__label__z" }) {
+      dict->insert(symbol);
+    }
+    dict->threshold(1, 1);
+  }
+
+  Base token(const string& symbol) const {
+    return Base(dict->getId(symbol), 1.0);
+  }
+
+  ParseResults example(
+      const string& lhs,
+      const vector<string>& labels) const {
+    ParseResults ex;
+    ex.LHSTokens.push_back(token(lhs));
+    for (const auto& label : labels) {
+      ex.RHSTokens.push_back(token("__label__" + label));
+    }
+    return ex;
+  }
+};
+
+}
+
+TEST(EmbedModel, hardNegativesSkipPositives) {
+  Fixture f;
+  EmbedModel model(f.args, f.dict);
+  for (int trainMode : { 0, 2 }) {
+    f.args->trainMode = trainMode;
+    InternDataHandler data(f.args);
+    vector<Corpus> corpora(1);
+    corpora[0].push_back(f.example("a", { "x", "y", "z" }));
+    corpora[0].push_back(f.example("b", { "x", "w" }));
+    data.addCorpora(corpora, "test");
+    data.initRHSNegatives();
+    atomic<bool> stop(false);
+    model.buildHardNegIndex(data, stop, 0);
+
+    // The query is the projection of a positive of the second example, so
+    // the candidates closest to it are positives too.
+    vector<ParseResults> batch(1);
+    data.getExampleById(1, batch[0]);
+    vector<Matrix<Real>> lhs(1);
+    model.projectRHS({ f.token("__label__x") }, lhs[0]);
+    vector<int32_t> ids;
+    model.hardNegatives(data, batch, lhs, 10, ids);
+
+    // trainMode 0: x, y, z, w. trainMode 2: { y, z }, { x, z }, { x, y },
+    // { w }, { x }. Only those with neither x nor w are negatives.
+    vector<Base> candidate;
+    vector<vector<Base>> negatives;
+    for (auto id : ids) {
+      data.getRHSCandidate(id, candidate);
+      negatives.push_back(candidate);
+    }
+    vector<vector<Base>> expected;
+    if (trainMode == 0) {
+      expected = { { f.token("__label__y") }, { f.token("__label__z") } };
+    } else {
+      expected = { { f.token("__label__y"), f.token("__label__z") } };
+    }
+    sort(negatives.begin(), negatives.end());
+    EXPECT_EQ(negatives, expected) << "trainMode " << trainMode;
+  }
+}
+
+TEST(EmbedModel, inBatchScoresMatchSimilarity) {
+  Fixture f;
+  for (auto similarity : { "cosine", "dot" }) {
+    f.args->similarity = similarity;
+    EmbedModel model(f.args, f.dict);
+    vector<Matrix<Real>> lhs(2), rhs(3);
+    model.projectLHS({ f.token("a") }, lhs[0]);
+    model.projectLHS({ f.token("a"), f.token("b") }, lhs[1]);
+    model.projectRHS({ f.token("__label__w") }, rhs[0]);
+    model.projectRHS({ f.token("__label__x") }, rhs[1]);
+    model.projectRHS({ f.token("__label__y"), f.token("__label__z") }, rhs[2]);
+    Matrix<Real> scores;
+    EmbedModel::projectedSimilarities(lhs, rhs, scores);
+    ASSERT_EQ(scores.numRows(), 2);
+    ASSERT_EQ(scores.numCols(), 3);
+    for (size_t i = 0; i < lhs.size(); i++) {
+      for (size_t j = 0; j < rhs.size(); j++) {
+        EXPECT_NEAR(scores.matrix(i, j), model.similarity(lhs[i], rhs[j]),
+                    1e-5) << similarity << " (" << i << ", " << j << ")";
+      }
+    }
+  }
+}
+
+TEST(EmbedModel, inBatchNegatives) {
+  Fixture f;
+  f.args->inBatchNeg = true;
+  EmbedModel model(f.args, f.dict);
+  // Sampled negatives are w or z, never a positive of the batch.
+  auto data = make_shared<InternDataHandler>(f.args);
+  vector<Corpus> corpora(1);
+  corpora[0].push_back(f.example("a", { "w" }));
+  corpora[0].push_back(f.example("b", { "z" }));
+  data->addCorpora(corpora, "test");
+  data->initRHSNegatives();
+  vector<ParseResults> batch = { f.example("a", { "x" }),
+                                 f.example("b", { "y" }) };
+  vector<Matrix<Real>> lhs(2), rhsP(2);
+  for (size_t i = 0; i < batch.size(); i++) {
+    model.projectLHS(batch[i].LHSTokens, lhs[i]);
+    model.projectRHS(batch[i].RHSTokens, rhsP[i]);
+  }
+
+  // The positives of the batch come first, then negSearchLimit minus the
+  // batch size sampled ones.
+  vector<vector<Base>> negLabels;
+  vector<Matrix<Real>> rhsN;
+  model.batchNegatives(*data, batch, lhs, rhsP, 5, 0.0, false, negLabels,
+                       rhsN);
+  ASSERT_EQ(negLabels.size(), 5);
+  ASSERT_EQ(rhsN.size(), 5);
+  for (size_t i = 0; i < batch.size(); i++) {
+    EXPECT_EQ(negLabels[i], batch[i].RHSTokens);
+    EXPECT_EQ(rhsN[i].matrix(0, 0), rhsP[i].matrix(0, 0));
+  }
+  for (size_t j = batch.size(); j < negLabels.size(); j++) {
+    EXPECT_TRUE(negLabels[j] == vector<Base>{ f.token("__label__w") } ||
+                negLabels[j] == vector<Base>{ f.token("__label__z") });
+  }
+  // Fewer than the batch size: only the positives of the batch.
+  model.batchNegatives(*data, batch, lhs, rhsP, 1, 0.0, false, negLabels,
+                       rhsN);
+  EXPECT_EQ(negLabels.size(), 2);
+
+  // With a margin no score can make up for, every negative but the
+  // example's own positive is a violation.
+  f.args->margin = 10.0;
+  f.args->maxNegSamples = 100;
+  EmbedModel::BatchStats stats;
+  model.trainOneBatch(data, batch, 5, 0.0, false, &stats);
+  EXPECT_EQ(stats.violations, 2 * 4);
+  EXPECT_EQ(stats.updates, 0);
+}
+
+TEST(EmbedModel, pruneKeepsTrainedBuckets) {
+  auto args = make_shared<Args>();
+  args->dim = 10;
+  args->ngrams = 2;
+  args->bucket = 1000;
+  // Every negative violates the margin, so every example is trained on.
+  args->margin = 10.0;
+  auto dict = make_shared<Dictionary>(args);
+  vector<string> lines = { "a b c __label__x", "d e __label__y",
+                           "f g h __label__z" };
+  for (const auto& line : lines) {
+    istringstream in(line);
+    string symbol;
+    while (in >> symbol) {
+      dict->insert(symbol);
+    }
+  }
+  dict->threshold(1, 1);
+  EmbedModel model(args, dict);
+
+  // The buckets of the ngrams of the lines are the ones training updates.
+  auto parser = make_shared<DataParser>(dict, args);
+  const int32_t firstBucket = dict->nwords() + dict->nlabels();
+  set<int64_t> hit;
+  vector<Corpus> corpora(1);
+  for (const auto& line : lines) {
+    ParseResults example;
+    ASSERT_TRUE(parser->parse(line, example));
+    for (const auto& token : example.LHSTokens) {
+      if (token.first >= firstBucket) {
+        hit.insert(token.first - firstBucket);
+      }
+    }
+    corpora[0].push_back(example);
+  }
+  ASSERT_EQ(hit.size(), 5);
+  auto examples = corpora[0];
+  auto data = make_shared<InternDataHandler>(args);
+  data->addCorpora(corpora, "test");
+  data->initRHSNegatives();
+  for (const auto& example : examples) {
+    model.trainOneBatch(data, { example }, 2, 0.01);
+  }
+
+  model.prune(dict->nwords());
+  for (int64_t b = 0; b < args->bucket; b++) {
+    EXPECT_EQ(dict->ngramIndex(b) >= 0, hit.count(b) > 0) << "bucket " << b;
+  }
+  EXPECT_EQ(dict->nbuckets(), hit.size());
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../utils/normalize.h"
+#include "../dict.h"
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+void expectSameAsReference(const string& input) {
+  string expected = input;
+  normalize_text_scalar(expected);
+
+  string simd = input;
+  normalize_text(simd);
+  EXPECT_EQ(simd, expected) << "'" << input << "'";
+
+  string hashed = input;
+  uint32_t h = normalize_text_hash(hashed);
+  EXPECT_EQ(hashed, expected);
+  EXPECT_EQ(h, Dictionary::hash(expected));
+}
+
+}
+
+TEST(Normalize, examples) {
+  for (string s : { "", "Hello", "$1,234.56", "iPhone7", "ÉCOLE",
+                    "12 Monkeys", "1234567890123456789-0",
+                    "MiXeD CaSe ThAt Is LoNgEr ThAn SiXtEeN",
+                    "00:11:22:33:44:55:66:77:88", "été-2019" }) {
+    expectSameAsReference(s);
+  }
+}
+
+TEST(Normalize, randomStrings) {
+  // Every byte but NUL, weighted towards the classes that matter, at
+  // lengths around the vector width.
+  const string common = "09AZaz@[`{/:-. Mm5";
+  minstd_rand rng(7);
+  for (int iter = 0; iter < 5000; iter++) {
+    size_t len = rng() % 70;
+    bool numeric = rng() % 2;
+    string s;
+    for (size_t i = 0; i < len; i++) {
+      char c;
+      if (numeric) {
+        c = "0123456789.,-$"[rng() % 14];
+      } else if (rng() % 3) {
+        c = common[rng() % common.size()];
+      } else {
+        c = char(1 + rng() % 255);
+      }
+      s.push_back(c);
+    }
+    expectSameAsReference(s);
+  }
+}
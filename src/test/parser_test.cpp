@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../parser.h"
+#include "../utils/utils.h"
+#include <gtest/gtest.h>
+#include <boost/algorithm/string.hpp>
+#include <fstream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace starspace;
+
+TEST(Parser, splitTokensMatchesBoostSplit) {
+  vector<boost::string_view> tokens;
+  for (string line : { "", "a", "a b", "a  b\tc ", "\t", "  x" }) {
+    vector<string> expected;
+    boost::split(expected, line, boost::is_any_of("\t "));
+    split_tokens(line, "\t ", tokens);
+    ASSERT_EQ(tokens.size(), expected.size()) << "'" << line << "'";
+    for (size_t i = 0; i < tokens.size(); i++) {
+      EXPECT_EQ(tokens[i].to_string(), expected[i]);
+    }
+  }
+}
+
+TEST(Parser, readLinesFromFileAndPipe) {
+  vector<string> lines;
+  for (int i = 0; i < 1000; i++) {
+    lines.push_back(string(i % 17, 'a' + i % 26));
+  }
+  auto write = [&](const string& path) {
+    ofstream out(path);
+    for (size_t i = 0; i < lines.size(); i++) {
+      // No newline after the last line.
+      out << lines[i] << (i + 1 < lines.size() ? "\n" : "");
+    }
+  };
+
+  char dir[] = "/tmp/parser_testXXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  string file = string(dir) + "/lines";
+  write(file);
+  for (int numThreads : { 1, 3 }) {
+    vector<vector<string>> read(numThreads);
+    ASSERT_TRUE(read_lines(file, [&](int i, boost::string_view line) {
+      read[i].push_back(line.to_string());
+    }, numThreads));
+    vector<string> all;
+    for (const auto& r : read) {
+      all.insert(all.end(), r.begin(), r.end());
+    }
+    EXPECT_EQ(all, lines);
+  }
+  remove(file.c_str());
+
+  string fifo = string(dir) + "/fifo";
+  ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+  thread writer([&]() { write(fifo); });
+  vector<string> read;
+  ASSERT_TRUE(read_lines(fifo, [&](int i, boost::string_view line) {
+    EXPECT_EQ(i, 0);
+    read.push_back(line.to_string());
+  }, 3));
+  writer.join();
+  EXPECT_EQ(read, lines);
+  remove(fifo.c_str());
+  rmdir(dir);
+
+  EXPECT_FALSE(read_lines(file, [](int, boost::string_view) {}));
+}
+
+TEST(Parser, parseWeights) {
+  auto args = make_shared<Args>();
+  args->useWeight = true;
+  auto dict = make_shared<Dictionary>(args);
+  DataParser parser(dict, args);
+  string line = "__weight__:0.5 cat:0.25 dog __label__pet:2\n";
+
+  vector<string> tokens;
+  parser.parseForDict(line, tokens);
+  EXPECT_EQ(tokens, vector<string>({ "cat", "dog", "__label__pet" }));
+  for (const auto& t : tokens) {
+    dict->insert(t);
+  }
+  dict->computeCounts();
+
+  ParseResults example;
+  ASSERT_TRUE(parser.parse(line, example));
+  EXPECT_FLOAT_EQ(example.weight, 0.5);
+  ASSERT_EQ(example.LHSTokens.size(), 2);
+  EXPECT_EQ(example.LHSTokens[0].first, dict->getId("cat"));
+  EXPECT_FLOAT_EQ(example.LHSTokens[0].second, 0.25);
+  EXPECT_EQ(example.LHSTokens[1].first, dict->getId("dog"));
+  EXPECT_FLOAT_EQ(example.LHSTokens[1].second, 1.0);
+  ASSERT_EQ(example.RHSTokens.size(), 1);
+  EXPECT_EQ(example.RHSTokens[0].first, dict->getId("__label__pet"));
+  EXPECT_FLOAT_EQ(example.RHSTokens[0].second, 2.0);
+}
+
+TEST(Parser, parseNormalizesText) {
+  auto args = make_shared<Args>();
+  args->normalizeText = true;
+  auto dict = make_shared<Dictionary>(args);
+  dict->insert("hello");
+  dict->insert("__label__x");
+  dict->computeCounts();
+  DataParser parser(dict, args);
+
+  string line = "HeLLo unknown __label__x";
+  ParseResults example;
+  ASSERT_TRUE(parser.parse(line, example));
+  ASSERT_EQ(example.LHSTokens.size(), 1);
+  EXPECT_EQ(example.LHSTokens[0].first, dict->getId("hello"));
+}
+
+TEST(Parser, hashedLookupsMatchTokenLookups) {
+  auto args = make_shared<Args>();
+  args->ngrams = 2;
+  args->bucket = 1000;
+  auto dict = make_shared<Dictionary>(args);
+  for (string w : { "the", "quick", "brown", "fox", "__label__a" }) {
+    dict->insert(w);
+  }
+  dict->computeCounts();
+  DataParser parser(dict, args);
+
+  for (string w : { "the", "fox", "__label__a", "missing" }) {
+    EXPECT_EQ(dict->getId(w, dict->hash(w)), dict->getId(w));
+  }
+
+  string line = "the quick __label__a brown fox";
+  ParseResults example;
+  ASSERT_TRUE(parser.parse(line, example));
+
+  vector<boost::string_view> tokens;
+  split_tokens(line, " ", tokens);
+  vector<Base> ngrams;
+  parser.addNgrams(tokens, ngrams, args->ngrams);
+  ASSERT_EQ(ngrams.size(), 3);
+  ASSERT_EQ(example.LHSTokens.size(), 4 + ngrams.size());
+  for (size_t i = 0; i < ngrams.size(); i++) {
+    EXPECT_EQ(example.LHSTokens[4 + i].first, ngrams[i].first);
+    EXPECT_GE(ngrams[i].first, dict->nwords() + dict->nlabels());
+  }
+}
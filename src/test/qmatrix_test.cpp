@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../qmatrix.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+using namespace starspace;
+
+namespace {
+
+Matrix<float> randomMatrix(size_t rows, size_t cols) {
+  Matrix<float> m({rows, cols}, 0.0);
+  m.randomInit(1.0);
+  return m;
+}
+
+}
+
+TEST(QMatrix, reconstructsRowsWithinHalfAStep) {
+  auto m = randomMatrix(20, 16);
+  QMatrix q(m);
+  EXPECT_EQ(q.numRows(), 20);
+  EXPECT_EQ(q.numCols(), 16);
+  for (size_t i = 0; i < m.numRows(); i++) {
+    for (size_t j = 0; j < m.numCols(); j++) {
+      EXPECT_NEAR(q.scale(i) * q.codes(i)[j], m[i][j],
+                  q.scale(i) / 2 + 1e-6);
+    }
+  }
+}
+
+TEST(QMatrix, zeroRow) {
+  Matrix<float> m({2, 4}, 0.0);
+  m.forEachCell([](float& c) { c = 0.0; });
+  m[1][2] = 3.0;
+  QMatrix q(m);
+  EXPECT_EQ(q.squaredNorm(0), 0.0);
+  EXPECT_FLOAT_EQ(q.squaredNorm(1), 9.0);
+}
+
+TEST(QMatrix, asymmetricDotMatchesFloat) {
+  auto m = randomMatrix(10, 32);
+  auto query = randomMatrix(1, 32);
+  QMatrix q(m);
+  for (size_t i = 0; i < m.numRows(); i++) {
+    // Every cell is off by at most half a quantization step.
+    float expected = 0.0, bound = 0.0;
+    for (size_t j = 0; j < m.numCols(); j++) {
+      expected += query[0][j] * m[i][j];
+      bound += fabs(query[0][j]) * q.scale(i) / 2;
+    }
+    EXPECT_NEAR(q.dot(query[0], i), expected, bound + 1e-4);
+  }
+}
+
+TEST(QMatrix, forwardIsWeightedSum) {
+  auto m = randomMatrix(5, 8);
+  QMatrix q(m);
+  Matrix<float> out;
+  q.forward({ {1, 1.0}, {3, 0.5} }, out);
+  ASSERT_EQ(out.numRows(), 1);
+  ASSERT_EQ(out.numCols(), 8);
+  for (size_t j = 0; j < 8; j++) {
+    float expected = q.scale(1) * q.codes(1)[j] +
+                     0.5 * q.scale(3) * q.codes(3)[j];
+    EXPECT_FLOAT_EQ(out[0][j], expected);
+  }
+}
+
+TEST(QMatrix, saveAndLoad) {
+  auto m = randomMatrix(7, 12);
+  QMatrix q(m);
+  stringstream ss;
+  q.save(ss, true, 2);
+
+  QMatrix loaded;
+  loaded.load(ss, true, 2);
+  ASSERT_EQ(loaded.numRows(), q.numRows());
+  ASSERT_EQ(loaded.numCols(), q.numCols());
+  for (size_t i = 0; i < q.numRows(); i++) {
+    EXPECT_EQ(loaded.scale(i), q.scale(i));
+    for (size_t j = 0; j < q.numCols(); j++) {
+      EXPECT_EQ(loaded.codes(i)[j], q.codes(i)[j]);
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "../train_monitor.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace starspace;
+
+TEST(TrainMonitor, aggregatesThreads) {
+  TrainMonitor monitor(3, 100, 0, 1,
+                       chrono::high_resolution_clock::now(), 1000.0);
+  vector<thread> threads;
+  for (int t = 0; t < 3; t++) {
+    threads.emplace_back([&monitor, t]() {
+      for (int i = 0; i < 10; i++) {
+        monitor.addExample(t);
+        monitor.addBatch(t, t + 1.0, 2, 1);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_DOUBLE_EQ(monitor.meanLoss(), 2.0);
+}
+
+TEST(TrainMonitor, writesMetrics) {
+  ostringstream err, metrics;
+  {
+    TrainMonitor monitor(2, 4, 1, 2,
+                         chrono::high_resolution_clock::now(), 1000.0);
+    monitor.setRate(0.01);
+    monitor.start(100.0, &err, &metrics);
+    monitor.addExample(0);
+    monitor.addExample(1);
+    monitor.addBatch(1, 0.5, 3, 1);
+    monitor.stop();
+  }
+  // Only the summary of the epoch, as the interval is not over.
+  string line = metrics.str();
+  EXPECT_EQ(count(line.begin(), line.end(), '\n'), 1);
+  EXPECT_EQ(line.find("{\"event\":\"epoch\",\"epoch\":1,"), 0);
+  EXPECT_NE(line.find("\"epoch_progress\":0.5,"), string::npos);
+  EXPECT_NE(line.find("\"examples\":2,\"batches\":1,"), string::npos);
+  EXPECT_NE(line.find("\"loss\":0.5,\"lr\":0.01,"), string::npos);
+  EXPECT_NE(line.find("\"violations\":3,\"updates\":1,"), string::npos);
+  EXPECT_NE(line.find("\"thread_examples_per_sec\":["), string::npos);
+  EXPECT_NE(err.str().find("Epoch: 50.0%"), string::npos);
+}
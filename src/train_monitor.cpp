@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "train_monitor.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace starspace {
+
+using namespace std;
+
+namespace {
+
+double secondsBetween(TrainMonitor::Time from, TrainMonitor::Time to) {
+  return chrono::duration<double>(to - from).count();
+}
+
+}
+
+TrainMonitor::TrainMonitor(
+    int numThreads, long examplesPerEpoch, int epoch, int numEpochs,
+    Time trainStart, double maxTrainTime)
+  : numThreads_(numThreads),
+    examplesPerEpoch_(examplesPerEpoch),
+    epoch_(epoch),
+    numEpochs_(numEpochs),
+    trainStart_(trainStart),
+    epochStart_(chrono::high_resolution_clock::now()),
+    maxTrainTime_(maxTrainTime),
+    counters_(new Counters[numThreads]),
+    lastReport_(epochStart_) {}
+
+TrainMonitor::~TrainMonitor() {
+  stop();
+}
+
+void TrainMonitor::start(
+    double interval, ostream* err, ostream* metrics) {
+  err_ = err;
+  metrics_ = metrics;
+  if (err_ == nullptr && metrics_ == nullptr) {
+    return;
+  }
+  auto period = chrono::duration<double>((std::max)(interval, 0.01));
+  reporter_ = thread([this, period] {
+    unique_lock<mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, period, [this] { return stopping_; })) {
+      report(false);
+    }
+  });
+}
+
+void TrainMonitor::stop() {
+  if (!reporter_.joinable()) {
+    return;
+  }
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  reporter_.join();
+  report(true);
+}
+
+TrainMonitor::Totals TrainMonitor::totals() const {
+  Totals t;
+  for (int i = 0; i < numThreads_; i++) {
+    const auto& c = counters_[i];
+    t.examples += c.examples.load(memory_order_relaxed);
+    t.batches += c.batches.load(memory_order_relaxed);
+    t.loss += c.loss.load(memory_order_relaxed);
+    t.violations += c.violations.load(memory_order_relaxed);
+    t.updates += c.updates.load(memory_order_relaxed);
+  }
+  return t;
+}
+
+double TrainMonitor::meanLoss() const {
+  auto t = totals();
+  return t.batches > 0 ? t.loss / t.batches : 0.0;
+}
+
+void TrainMonitor::report(bool final) {
+  auto now = chrono::high_resolution_clock::now();
+  auto t = totals();
+  double loss = t.batches > 0 ? t.loss / t.batches : 0.0;
+  double rate = rate_.load(memory_order_relaxed);
+  double totSpent = secondsBetween(trainStart_, now);
+  double epochSpent = (std::max)(secondsBetween(epochStart_, now), 1e-9);
+  double exPerSec = t.examples / epochSpent;
+  double sinceLast = secondsBetween(lastReport_, now);
+  double recentExPerSec = sinceLast > 0.0 ?
+    (t.examples - lastExamples_) / sinceLast : exPerSec;
+  lastExamples_ = t.examples;
+  lastReport_ = now;
+
+  // Progress over all the epochs, and the time left at the current
+  // throughput, within the training time budget.
+  double epochProgress = examplesPerEpoch_ > 0 ?
+    double(t.examples) / examplesPerEpoch_ : 1.0;
+  double exLeft = (std::max)(
+      double(examplesPerEpoch_) * (numEpochs_ - epoch_) - t.examples, 0.0);
+  double exDone = double(examplesPerEpoch_) * epoch_ + t.examples;
+  double progress = exDone + exLeft > 0 ? exDone / (exDone + exLeft) : 1.0;
+  double eta = exPerSec > 0.0 ? exLeft / exPerSec : 0.0;
+  if (eta > maxTrainTime_ - totSpent) {
+    eta = (std::max)(maxTrainTime_ - totSpent, 0.0);
+    progress = totSpent / (eta + totSpent);
+  }
+
+  if (err_ != nullptr) {
+    int etah = int(eta) / 3600;
+    int etam = (int(eta) - etah * 3600) / 60;
+    int toth = int(totSpent) / 3600;
+    int totm = (int(totSpent) - toth * 3600) / 60;
+    int tots = int(totSpent) - toth * 3600 - totm * 60;
+    auto& err = *err_;
+    err << fixed;
+    err << "\rEpoch: " << setprecision(1) << 100 * epochProgress << "%";
+    err << "  lr: " << setprecision(6) << rate;
+    err << "  loss: " << setprecision(6) << loss;
+    err << "  ex/s: " << setprecision(0) << exPerSec;
+    if (eta < 60) {
+      err << "  eta: <1min ";
+    } else {
+      err << "  eta: " << etah << "h" << etam << "m";
+    }
+    err << "  tot: " << toth << "h" << totm << "m" << tots << "s ";
+    err << " (" << setprecision(1) << 100 * progress << "%)";
+    err << flush;
+  }
+
+  if (metrics_ != nullptr) {
+    // Each record is written whole, so that the file can be followed.
+    ostringstream line;
+    line << setprecision(6);
+    line << "{\"event\":\"" << (final ? "epoch" : "progress") << "\""
+         << ",\"epoch\":" << epoch_
+         << ",\"time\":" << totSpent
+         << ",\"epoch_progress\":" << epochProgress
+         << ",\"examples\":" << t.examples
+         << ",\"batches\":" << t.batches
+         << ",\"examples_per_sec\":" << exPerSec
+         << ",\"recent_examples_per_sec\":" << recentExPerSec
+         << ",\"loss\":" << loss
+         << ",\"lr\":" << rate
+         << ",\"violations\":" << t.violations
+         << ",\"updates\":" << t.updates
+         << ",\"eta\":" << eta
+         << ",\"thread_examples_per_sec\":[";
+    for (int i = 0; i < numThreads_; i++) {
+      line << (i ? "," : "")
+           << counters_[i].examples.load(memory_order_relaxed) / epochSpent;
+    }
+    line << "]}\n";
+    *metrics_ << line.str() << flush;
+  }
+}
+
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// TrainMonitor counts what the training threads do in an epoch and
+// reports their throughput, the loss and the learning rate while it runs.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace starspace {
+
+class TrainMonitor {
+public:
+  typedef std::chrono::time_point<std::chrono::high_resolution_clock> Time;
+
+  // examplesPerEpoch examples are shared by numThreads threads; this is
+  // epoch number epoch (from 0) of numEpochs, and training started at
+  // trainStart with a budget of maxTrainTime seconds.
+  TrainMonitor(int numThreads, long examplesPerEpoch, int epoch,
+               int numEpochs, Time trainStart, double maxTrainTime);
+  ~TrainMonitor();
+
+  // The counters of thread i, which only thread i may update. They are
+  // not shared with any other thread's, and updating them takes no lock.
+  void addExample(int i) { bump(counters_[i].examples, 1L); }
+  void addBatch(int i, double loss, long violations, long updates) {
+    auto& c = counters_[i];
+    bump(c.batches, 1L);
+    bump(c.loss, loss);
+    bump(c.violations, violations);
+    bump(c.updates, updates);
+  }
+  void setRate(double rate) {
+    rate_.store(rate, std::memory_order_relaxed);
+  }
+
+  // Report every interval seconds to err and, if metrics is not null, as
+  // one JSON object per line to metrics, until stop().
+  void start(double interval, std::ostream* err, std::ostream* metrics);
+  // Stop reporting, after a last report and a summary of the epoch.
+  void stop();
+
+  // The mean loss of the batches so far.
+  double meanLoss() const;
+
+private:
+  struct Counters {
+    // Keeps the counters of two threads off the same cache line.
+    char pad[64];
+    std::atomic<long> examples{0};
+    std::atomic<long> batches{0};
+    std::atomic<double> loss{0.0};
+    // Negatives which scored within the margin of the positive (with
+    // softmax, every negative scored).
+    std::atomic<long> violations{0};
+    // Examples whose gradient was applied to the embeddings.
+    std::atomic<long> updates{0};
+  };
+
+  struct Totals {
+    long examples = 0;
+    long batches = 0;
+    double loss = 0.0;
+    long violations = 0;
+    long updates = 0;
+  };
+
+  template <typename T>
+  static void bump(std::atomic<T>& counter, T n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  Totals totals() const;
+  void report(bool final);
+
+  int numThreads_;
+  long examplesPerEpoch_;
+  int epoch_;
+  int numEpochs_;
+  Time trainStart_;
+  Time epochStart_;
+  double maxTrainTime_;
+  std::unique_ptr<Counters[]> counters_;
+  std::atomic<double> rate_{0.0};
+
+  std::ostream* err_ = nullptr;
+  std::ostream* metrics_ = nullptr;
+  // Examples at the previous report, for the recent throughput.
+  long lastExamples_ = 0;
+  Time lastReport_;
+
+  std::thread reporter_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+};
+
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "alias_table.h"
+
+#include <assert.h>
+#include <atomic>
+#include <cmath>
+
+namespace starspace {
+
+AliasTable::AliasTable(const std::vector<double>& weights) {
+  const size_t n = weights.size();
+  double sum = 0.0;
+  for (auto w : weights) {
+    assert(w >= 0.0);
+    sum += w;
+  }
+  assert(n > 0 && sum > 0.0);
+
+  // Vose's method: pair every outcome below the average weight with one
+  // above it, which gives it what its own bucket lacks.
+  buckets_.resize(n);
+  std::vector<double> scaled(n);
+  std::vector<int32_t> small, large;
+  for (size_t i = 0; i < n; i++) {
+    scaled[i] = weights[i] * n / sum;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    int32_t s = small.back();
+    int32_t l = large.back();
+    small.pop_back();
+    buckets_[s].threshold = uint32_t(std::ldexp(scaled[s], 32));
+    buckets_[s].alias = l;
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // What is left fills its own bucket, up to rounding errors.
+  for (auto v : { &small, &large }) {
+    for (auto i : *v) {
+      buckets_[i].threshold = UINT32_MAX;
+      buckets_[i].alias = i;
+    }
+  }
+}
+
+std::mt19937_64& AliasTable::threadRng() {
+  // Threads are seeded in the order they first sample.
+  static std::atomic<uint64_t> nextSeed(0);
+  static thread_local std::mt19937_64 rng(nextSeed++);
+  return rng;
+}
+
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Sampling from a fixed discrete distribution in constant time, with
+ * Walker's alias method: each of the n outcomes owns a bucket of
+ * probability 1/n, split between itself and one other outcome, its alias.
+ * A sample picks a bucket, then one of its two outcomes, out of a single
+ * 64 bit random number and a single lookup.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace starspace {
+
+class AliasTable {
+public:
+  AliasTable() {}
+  // Outcome i is drawn with probability weights[i] / sum(weights). Weights
+  // must not be negative, and at least one must be positive.
+  explicit AliasTable(const std::vector<double>& weights);
+
+  size_t size() const { return buckets_.size(); }
+  bool empty() const { return buckets_.empty(); }
+  size_t memoryUsage() const { return buckets_.capacity() * sizeof(Bucket); }
+
+  // An outcome drawn with the random number r.
+  int32_t sample(uint64_t r) const {
+    // The high half picks the bucket, the low half one of its outcomes.
+    uint64_t i = ((r >> 32) * buckets_.size()) >> 32;
+    const auto& b = buckets_[i];
+    return uint32_t(r) < b.threshold ? int32_t(i) : b.alias;
+  }
+
+  // An outcome drawn with a random generator owned by the calling thread,
+  // so that threads can sample concurrently.
+  int32_t sample() const { return sample(threadRng()()); }
+
+  static std::mt19937_64& threadRng();
+
+private:
+  struct Bucket {
+    // Bucket i gives i for random numbers below threshold, alias otherwise.
+    uint32_t threshold;
+    int32_t alias;
+  };
+
+  std::vector<Bucket> buckets_;
+};
+
+}
@@ -23,6 +23,8 @@ Args::Args() {
   norm = 1.0;
   margin = 0.05;
   wordWeight = 0.5;
+  wordNegPower = 1.0;
+  labelNegPower = 1.0;
   initRandSd = 0.001;
   dropoutLHS = 0.0;
   dropoutRHS = 0.0;
@@ -51,6 +53,7 @@ Args::Args() {
   loss = "hinge";
   similarity = "cosine";
   isTrain = false;
+  isQuantize = false;
   shareEmb = true;
   saveEveryEpoch = false;
   saveTempModel = false;
@@ -59,6 +62,20 @@ Args::Args() {
   excludeLHS = false;
   weightSep = ':';
   numGzFile = 1;
+  queryCacheSize = 0;
+  cutoff = 0;
+  saveInterval = 0;
+  keepCheckpoints = 0;
+  dictBudget = 0;
+  hardNegatives = 0;
+  hardNegRefresh = 1000;
+  mmapModel = false;
+  mmapWriteBack = false;
+  singlePass = false;
+  inBatchNeg = false;
+  pinRows = "";
+  metricsFile = "";
+  reportInterval = 1.0;
 }
 
 bool Args::isTrue(string arg) {
@@ -70,7 +87,7 @@ bool Args::isTrue(string arg) {
 
 void Args::parseArgs(int argc, char** argv) {
   if (argc <= 1) {
-    cerr << "Usage: need to specify whether it is train or test.\n";
+    cerr << "Usage: need to specify whether it is train, test or quantize.\n";
     printHelp();
     exit(EXIT_FAILURE);
   }
@@ -78,12 +95,15 @@ void Args::parseArgs(int argc, char** argv) {
     isTrain = true;
   } else if (strcmp(argv[1], "test") == 0) {
     isTrain = false;
+  } else if (strcmp(argv[1], "quantize") == 0) {
+    isTrain = false;
+    isQuantize = true;
   } else if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "-help") == 0) {
     std::cerr << "Here is the help! Usage:" << std::endl;
     printHelp();
     exit(EXIT_FAILURE);
   } else {
-    cerr << "Usage: the first argument should be either train or test.\n";
+    cerr << "Usage: the first argument should be train, test or quantize.\n";
     printHelp();
     exit(EXIT_FAILURE);
   }
@@ -174,6 +194,10 @@ void Args::parseArgs(int argc, char** argv) {
       bucket = atoi(argv[i + 1]);
     } else if (strcmp(argv[i], "-ngrams") == 0) {
       ngrams = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-queryCacheSize") == 0) {
+      queryCacheSize = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-cutoff") == 0) {
+      cutoff = atoi(argv[i + 1]);
     } else if (strcmp(argv[i], "-K") == 0) {
       K = atoi(argv[i + 1]);
     } else if (strcmp(argv[i], "-batchSize") == 0) {
@@ -194,12 +218,40 @@ void Args::parseArgs(int argc, char** argv) {
       saveEveryEpoch = isTrue(string(argv[i + 1]));
     } else if (strcmp(argv[i], "-saveTempModel") == 0) {
       saveTempModel = isTrue(string(argv[i + 1]));
+    } else if (strcmp(argv[i], "-saveInterval") == 0) {
+      saveInterval = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-metricsFile") == 0) {
+      metricsFile = string(argv[i + 1]);
+    } else if (strcmp(argv[i], "-reportInterval") == 0) {
+      reportInterval = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "-keepCheckpoints") == 0) {
+      keepCheckpoints = atoi(argv[i + 1]);
     } else if (strcmp(argv[i], "-useWeight") == 0) {
       useWeight = isTrue(string(argv[i + 1]));
     } else if (strcmp(argv[i], "-trainWord") == 0) {
       trainWord = isTrue(string(argv[i + 1]));
     } else if (strcmp(argv[i], "-excludeLHS") == 0) {
       excludeLHS = isTrue(string(argv[i + 1]));
+    } else if (strcmp(argv[i], "-wordNegPower") == 0) {
+      wordNegPower = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "-labelNegPower") == 0) {
+      labelNegPower = atof(argv[i + 1]);
+    } else if (strcmp(argv[i], "-hardNegatives") == 0) {
+      hardNegatives = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-hardNegRefresh") == 0) {
+      hardNegRefresh = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-dictBudget") == 0) {
+      dictBudget = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-singlePass") == 0) {
+      singlePass = isTrue(string(argv[i + 1]));
+    } else if (strcmp(argv[i], "-inBatchNeg") == 0) {
+      inBatchNeg = isTrue(string(argv[i + 1]));
+    } else if (strcmp(argv[i], "-mmapModel") == 0) {
+      mmapModel = isTrue(string(argv[i + 1]));
+    } else if (strcmp(argv[i], "-mmapWriteBack") == 0) {
+      mmapWriteBack = isTrue(string(argv[i + 1]));
+    } else if (strcmp(argv[i], "-pinRows") == 0) {
+      pinRows = string(argv[i + 1]);
     } else {
       cerr << "Unknown argument: " << argv[i] << std::endl;
       printHelp();
@@ -213,6 +265,12 @@ void Args::parseArgs(int argc, char** argv) {
       printHelp();
       exit(EXIT_FAILURE);
     }
+  } else if (isQuantize) {
+    if (model.empty()) {
+      cerr << "Empty model path." << endl;
+      printHelp();
+      exit(EXIT_FAILURE);
+    }
   } else {
     if (testFile.empty() || model.empty()) {
       cerr << "Empty test file or model path." << endl;
@@ -254,19 +312,27 @@ void Args::parseArgs(int argc, char** argv) {
 
 void Args::printHelp() {
   cout << "\n"
-       << "\"starspace train ...\"  or \"starspace test ...\"\n\n"
+       << "\"starspace train ...\", \"starspace test ...\" or \"starspace quantize ...\"\n\n"
        << "The following arguments are mandatory for train: \n"
        << "  -trainFile       training file path\n"
        << "  -model           output model file path\n\n"
        << "The following arguments are mandatory for test: \n"
        << "  -testFile        test file path\n"
        << "  -model           model file path\n\n"
+       << "The following arguments are mandatory for quantize: \n"
+       << "  -model           model file path; the quantized model is saved to <model>.q\n"
+       << "If -testFile is given, quantize also reports the change in accuracy on it.\n"
+       << "The following arguments for quantize are optional:\n"
+       << "  -cutoff          if positive, prune the model after training, or before quantizing: keep this many of the most frequent words (and all labels),\n"
+       << "                   and drop the ngram buckets that were not updated in training. [" << cutoff << "]\n\n"
        << "The following arguments for the dictionary are optional:\n"
        << "  -minCount        minimal number of word occurences [" << minCount << "]\n"
        << "  -minCountLabel   minimal number of label occurences [" << minCountLabel << "]\n"
        << "  -ngrams          max length of word ngram [" << ngrams << "]\n"
        << "  -bucket          number of buckets [" << bucket << "]\n"
        << "  -label           labels prefix [" << label << "]\n"
+       << "  -dictBudget      if positive, each thread building the dictionary counts at most this many symbols at once, evicting the least\n"
+       << "                   frequent words, and the file is read a second time to count the remaining ones exactly. [" << dictBudget << "]\n"
        << "\nThe following arguments for training are optional:\n"
        << "  -initModel       if not empty, it loads a previously trained model in -initModel and carry on training.\n"
        << "  -trainMode       takes value in [0, 1, 2, 3, 4, 5], see Training Mode Section. [" << trainMode << "]\n"
@@ -275,12 +341,24 @@ void Args::printHelp() {
        << "  -validationPatience    number of iterations of validation where does not improve before we stop training [" << validationPatience << "]\n"
        << "  -saveEveryEpoch  save intermediate models after each epoch [" << saveEveryEpoch << "]\n"
        << "  -saveTempModel   save intermediate models after each epoch with an unique name including epoch number [" << saveTempModel << "]\n"
+       << "  -saveInterval    if positive, also save an intermediate model every this many seconds, to <model>_ckpt<n>. [" << saveInterval << "]\n"
+       << "  -keepCheckpoints number of uniquely named intermediate models kept on disk, older ones are deleted; 0 keeps all. [" << keepCheckpoints << "]\n"
+       << "  -metricsFile     if not empty, the training progress is also written to this file, one JSON object per line: throughput\n"
+       << "                   (overall and per thread), loss, learning rate, margin violations and updates.\n"
+       << "  -reportInterval  the training progress is reported every this many seconds. [" << reportInterval << "]\n"
        << "  -lr              learning rate [" << lr << "]\n"
        << "  -dim             size of embedding vectors [" << dim << "]\n"
        << "  -epoch           number of epochs [" << epoch << "]\n"
        << "  -maxTrainTime    max train time (secs) [" << maxTrainTime << "]\n"
        << "  -negSearchLimit  number of negatives sampled [" << negSearchLimit << "]\n"
        << "  -maxNegSamples   max number of negatives in a batch update [" << maxNegSamples << "]\n"
+       << "  -labelNegPower   negative labels (or documents) are sampled in proportion to their frequency in the training examples\n"
+       << "                   raised to this power; below 1, rare ones are sampled more often. [" << labelNegPower << "]\n"
+       << "  -hardNegatives   with hinge loss, how many of the negSearchLimit negatives of a batch are hard ones: labels (or documents)\n"
+       << "                   closest to the examples of the batch, found in an approximate nearest neighbor index of all of them. [" << hardNegatives << "]\n"
+       << "  -hardNegRefresh  the hard negatives index is rebuilt in the background every this many batches. [" << hardNegRefresh << "]\n"
+       << "  -inBatchNeg      use the labels of the other examples of a batch as negatives; only negSearchLimit minus batchSize negatives\n"
+       << "                   are then sampled. [" << inBatchNeg << "]\n"
        << "  -loss            loss function {hinge, softmax} [hinge]\n"
        << "  -margin          margin parameter in hinge loss. It's only effective if hinge loss is used. [" << margin << "]\n"
        << "  -similarity      takes value in [cosine, dot]. Whether to use cosine or dot product as similarity function in  hinge loss.\n"
@@ -293,13 +371,17 @@ void Args::printHelp() {
        << "  -initRandSd      initial values of embeddings are randomly generated from normal distribution with mean=0, standard deviation=initRandSd. [" << initRandSd << "]\n"
        << "  -trainWord       whether to train word level together with other tasks (for multi-tasking). [" << trainWord << "]\n"
        << "  -wordWeight      if trainWord is true, wordWeight specifies example weight for word level training examples. [" << wordWeight << "]\n"
+       << "  -wordNegPower    in trainMode 5 or with trainWord, negative words are sampled in proportion to their count raised to this power;\n"
+       << "                   0.75 samples rare words more often, as in word2vec. [" << wordNegPower << "]\n"
        << "  -batchSize       size of mini batch in training. [" << batchSize << "]\n"
+       << "  -singlePass      read the training file only once, building the dictionary and parsing the examples together. Only for fileFormat 'fastText'; takes more memory while reading. [" << singlePass << "]\n"
        << "\nThe following arguments for test are optional:\n"
        << "  -basedoc         file path for a set of labels to compare against true label. It is required when -fileFormat='labelDoc'.\n"
        << "                   In the case -fileFormat='fastText' and -basedoc is not provided, we compare true label with all other labels in the dictionary.\n"
        << "  -predictionFile  file path for save predictions. If not empty, top K predictions for each example will be saved.\n"
        << "  -K               if -predictionFile is not empty, top K predictions for each example will be saved.\n"
        << "  -excludeLHS      exclude elements in the LHS from predictions\n"
+       << "  -queryCacheSize  number of parsed queries whose projection and top K predictions are cached when serving queries; 0 disables the cache. [" << queryCacheSize << "]\n"
        <<  "\nThe following arguments are optional:\n"
        << "  -normalizeText   whether to run basic text preprocess for input files [" << normalizeText << "]\n"
        << "  -useWeight       whether input file contains weights [" << useWeight << "]\n"
@@ -307,8 +389,14 @@ void Args::printHelp() {
        << "  -verbose         verbosity level [" << verbose << "]\n"
        << "  -debug           whether it's in debug mode [" << debug << "]\n"
        << "  -thread          number of threads [" << thread << "]\n"
-       << "  -compressFile    whether to load a compressed file [" << compressFile << "]\n"
-       << "  -numGzFile       number of compressed file to load [" << numGzFile << "]\n"
+       << "  -compressFile    whether to load a compressed file. Files are decompressed in parallel when there are at least as many as threads, or\n"
+       << "                   when compressed with bgzip; an ordinary gzip file is decompressed on one thread, so recompress a single large\n"
+       << "                   file with bgzip to load it in parallel. Only gzip is supported. [" << compressFile << "]\n"
+       << "  -numGzFile       number of compressed file to load, for input files named <file>00.gz, <file>01.gz, ... Not needed when the\n"
+       << "                   input file is a single .gz file, a pattern like 'dir/*.gz' or @list, a file listing the input files. [" << numGzFile << "]\n"
+       << "  -mmapModel       page the lookup tables of a binary model in from the model file on demand instead of reading them into memory; when training from -initModel, that file is left unchanged. [" << mmapModel << "]\n"
+       << "  -mmapWriteBack   with -mmapModel, write training updates back to the -initModel file as well. [" << mmapWriteBack << "]\n"
+       << "  -pinRows         with -mmapModel, file with one symbol per line whose embeddings are kept resident in memory.\n"
        << std::endl;
 }
 
@@ -27,6 +27,8 @@ class Args {
     std::string basedoc;
     std::string loss;
     std::string similarity;
+    std::string pinRows;
+    std::string metricsFile;
 
     char weightSep;
     double lr;
@@ -38,6 +40,9 @@ class Args {
     double dropoutLHS;
     double dropoutRHS;
     double wordWeight;
+    double wordNegPower;
+    double labelNegPower;
+    double reportInterval;
     size_t dim;
     int epoch;
     int ws;
@@ -54,10 +59,18 @@ class Args {
     int K;
     int batchSize;
     int numGzFile;
+    int queryCacheSize;
+    int cutoff;
+    int saveInterval;
+    int keepCheckpoints;
+    int dictBudget;
+    int hardNegatives;
+    int hardNegRefresh;
     bool verbose;
     bool debug;
     bool adagrad;
     bool isTrain;
+    bool isQuantize;
     bool normalizeText;
     bool saveEveryEpoch;
     bool saveTempModel;
@@ -65,6 +78,10 @@ class Args {
     bool useWeight;
     bool trainWord;
     bool excludeLHS;
+    bool mmapModel;
+    bool mmapWriteBack;
+    bool singlePass;
+    bool inBatchNeg;
 
     void parseArgs(int, char**);
     void printHelp();
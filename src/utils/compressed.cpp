@@ -0,0 +1,494 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "compressed.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+#ifdef COMPRESS_FILE
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+namespace starspace {
+
+vector<string> gz_input_files(const string& name, int numGzFile) {
+  vector<string> files;
+  if (!name.empty() && name[0] == '@') {
+    ifstream in(name.substr(1));
+    if (!in.good()) {
+      cerr << "File list " << name.substr(1) << " cannot be opened!" << endl;
+      exit(EXIT_FAILURE);
+    }
+    string line;
+    while (getline(in, line)) {
+      while (!line.empty() && isspace(line.back())) {
+        line.pop_back();
+      }
+      if (!line.empty()) {
+        files.push_back(line);
+      }
+    }
+  } else if (name.find_first_of("*?[") != string::npos) {
+#ifndef _WIN32
+    glob_t matches;
+    if (glob(name.c_str(), 0, nullptr, &matches) == 0) {
+      for (size_t i = 0; i < matches.gl_pathc; i++) {
+        files.push_back(matches.gl_pathv[i]);
+      }
+    }
+    globfree(&matches);
+#endif
+  } else if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) {
+    files.push_back(name);
+  } else {
+    for (int i = 0; i < numGzFile; i++) {
+      files.push_back(name + boost::str(boost::format("%02d") % i) + ".gz");
+    }
+  }
+  return files;
+}
+
+#ifdef COMPRESS_FILE
+
+namespace {
+
+const size_t kChunk = 1 << 20;
+
+typedef function<void(int, boost::string_view)> LineFn;
+
+// Hands the complete lines of a stream of pieces to f on thread i, keeping
+// the partial last line for the next piece.
+class LineAssembler {
+public:
+  LineAssembler(const LineFn& f, int i) : f_(f), i_(i) {}
+
+  void add(const char* p, size_t len) {
+    const char* end = p + len;
+    while (p < end) {
+      auto nl = (const char*)memchr(p, '\n', end - p);
+      if (nl == nullptr) {
+        pending_.append(p, end);
+        return;
+      }
+      if (pending_.empty()) {
+        f_(i_, boost::string_view(p, nl - p));
+      } else {
+        pending_.append(p, nl);
+        f_(i_, pending_);
+        pending_.clear();
+      }
+      p = nl + 1;
+    }
+  }
+
+  void finish() {
+    if (!pending_.empty()) {
+      f_(i_, pending_);
+      pending_.clear();
+    }
+  }
+
+private:
+  const LineFn& f_;
+  int i_;
+  string pending_;
+};
+
+// Inflate a whole gzip file, any number of members long, passing the
+// output to out piece by piece.
+bool inflateFile(
+    const string& fname,
+    const function<void(const char*, size_t)>& out) {
+  ifstream in(fname, ifstream::binary);
+  if (!in.good()) {
+    cerr << "Skipping " << fname << ": it cannot be opened." << endl;
+    return false;
+  }
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+    return false;
+  }
+  vector<char> inBuf(kChunk);
+  vector<char> outBuf(kChunk);
+  int ret = Z_OK;
+  while (true) {
+    if (zs.avail_in == 0) {
+      in.read(inBuf.data(), inBuf.size());
+      if (in.gcount() == 0) {
+        break;
+      }
+      zs.next_in = (Bytef*)inBuf.data();
+      zs.avail_in = in.gcount();
+    }
+    zs.next_out = (Bytef*)outBuf.data();
+    zs.avail_out = outBuf.size();
+    ret = inflate(&zs, Z_NO_FLUSH);
+    size_t produced = outBuf.size() - zs.avail_out;
+    if (produced > 0) {
+      out(outBuf.data(), produced);
+    }
+    if (ret == Z_STREAM_END) {
+      // Another member may follow.
+      inflateReset(&zs);
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      break;
+    }
+  }
+  bool ok = (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && zs.total_in == 0));
+  if (!ok) {
+    cerr << "Warning: " << fname << " is corrupt or truncated." << endl;
+  }
+  inflateEnd(&zs);
+  return true;
+}
+
+uint32_t le16(const char* p) {
+  return uint8_t(p[0]) | (uint32_t(uint8_t(p[1])) << 8);
+}
+
+uint32_t le32(const char* p) {
+  return le16(p) | (le16(p + 2) << 16);
+}
+
+// Offsets of the members of a BGZF file, followed by its size. Returns
+// false if data is not BGZF.
+bool bgzfBlocks(const char* data, size_t size, vector<size_t>& blocks) {
+  blocks.clear();
+  size_t off = 0;
+  while (off < size) {
+    const char* h = data + off;
+    // gzip magic, deflate, and the FEXTRA flag.
+    if (size - off < 18 || uint8_t(h[0]) != 0x1f || uint8_t(h[1]) != 0x8b ||
+        h[2] != 8 || !(h[3] & 4)) {
+      return false;
+    }
+    size_t x = 12;
+    size_t xend = x + le16(h + 10);
+    int64_t bsize = -1;
+    while (x + 4 <= xend && off + x + 4 <= size) {
+      size_t slen = le16(h + x + 2);
+      if (h[x] == 'B' && h[x + 1] == 'C' && slen == 2 &&
+          off + x + 6 <= size) {
+        bsize = le16(h + x + 4);
+      }
+      x += 4 + slen;
+    }
+    if (bsize < 0 || off + bsize + 1 > size) {
+      return false;
+    }
+    blocks.push_back(off);
+    off += bsize + 1;
+  }
+  blocks.push_back(size);
+  return true;
+}
+
+// Inflates single BGZF members, reusing its zlib state.
+class BlockInflater {
+public:
+  BlockInflater() {
+    memset(&zs_, 0, sizeof(zs_));
+    inflateInit2(&zs_, 15 + 16);
+  }
+  ~BlockInflater() { inflateEnd(&zs_); }
+
+  bool inflateBlock(const char* block, size_t len, vector<char>& out) {
+    // The uncompressed size is the last field of the member.
+    out.resize(le32(block + len - 4));
+    if (out.empty()) {
+      return true;
+    }
+    inflateReset(&zs_);
+    zs_.next_in = (Bytef*)block;
+    zs_.avail_in = len;
+    zs_.next_out = (Bytef*)out.data();
+    zs_.avail_out = out.size();
+    return inflate(&zs_, Z_FINISH) == Z_STREAM_END;
+  }
+
+private:
+  z_stream zs_;
+};
+
+// Lines of a BGZF file on numThreads threads. Thread i inflates a range of
+// members, and reads the lines that start in it; the last of them may
+// end in a member of the next range.
+void readBgzf(
+    const string& fname,
+    const MappedFile& file,
+    const vector<size_t>& blocks,
+    const LineFn& f,
+    int numThreads) {
+  const size_t numBlocks = blocks.size() - 1;
+  auto body = [&](int i) {
+    size_t first = numBlocks * i / numThreads;
+    size_t last = numBlocks * (i + 1) / numThreads;
+    BlockInflater inflater;
+    vector<char> out;
+    auto inflateBlock = [&](size_t b) {
+      if (!inflater.inflateBlock(
+            file.data() + blocks[b], blocks[b + 1] - blocks[b], out)) {
+        cerr << "Warning: block " << b << " of " << fname
+             << " is corrupt." << endl;
+        out.clear();
+      }
+    };
+
+    // A line starts the range if the data before it ends with a newline.
+    bool skipping = false;
+    for (size_t b = first; b > 0; b--) {
+      inflateBlock(b - 1);
+      if (!out.empty()) {
+        skipping = (out.back() != '\n');
+        break;
+      }
+    }
+
+    string pending;
+    for (size_t b = first; b < numBlocks; b++) {
+      bool pastRange = (b >= last);
+      if (pastRange && (skipping || pending.empty())) {
+        return;
+      }
+      inflateBlock(b);
+      const char* p = out.data();
+      const char* end = out.data() + out.size();
+      if (skipping) {
+        auto nl = (const char*)memchr(p, '\n', end - p);
+        if (nl == nullptr) {
+          continue;
+        }
+        p = nl + 1;
+        skipping = false;
+      }
+      while (p < end) {
+        auto nl = (const char*)memchr(p, '\n', end - p);
+        if (nl == nullptr) {
+          pending.append(p, end);
+          break;
+        }
+        if (pending.empty()) {
+          f(i, boost::string_view(p, nl - p));
+        } else {
+          pending.append(p, nl);
+          f(i, pending);
+          pending.clear();
+        }
+        if (pastRange) {
+          return;
+        }
+        p = nl + 1;
+      }
+    }
+    if (!pending.empty()) {
+      f(i, pending);
+    }
+  };
+
+  vector<thread> threads;
+  for (int i = 0; i < numThreads; i++) {
+    threads.emplace_back(body, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+// Warn, once per file, that a gzip file split over threads is inflated by
+// one of them.
+void warnNotBgzf(const string& fname, int numThreads) {
+  static mutex warnedMutex;
+  static set<string> warned;
+  lock_guard<mutex> lock(warnedMutex);
+  if (!warned.insert(fname).second) {
+    return;
+  }
+  cerr << "Warning: " << fname << " is not compressed with bgzip, so it is "
+       << "decompressed on one thread, not " << numThreads << ". To "
+       << "decompress it in parallel, recompress it with\n"
+       << "  gunzip -c " << fname << " | bgzip -@ " << numThreads
+       << " > <new file>.gz\n"
+       << "or split it into at least " << numThreads << " .gz files."
+       << endl;
+}
+
+// Blocks of whole lines passed from one producer to many consumers.
+class BlockQueue {
+public:
+  explicit BlockQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+  void push(string&& block) {
+    unique_lock<mutex> lock(mutex_);
+    notFull_.wait(lock, [this]() { return blocks_.size() < capacity_; });
+    blocks_.push_back(std::move(block));
+    notEmpty_.notify_one();
+  }
+
+  bool pop(string& block) {
+    unique_lock<mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this]() { return closed_ || !blocks_.empty(); });
+    if (blocks_.empty()) {
+      return false;
+    }
+    block = std::move(blocks_.front());
+    blocks_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+
+  void close() {
+    lock_guard<mutex> lock(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool closed_;
+  deque<string> blocks_;
+  mutex mutex_;
+  condition_variable notEmpty_;
+  condition_variable notFull_;
+};
+
+// Lines of a gzip file that cannot be split: this thread inflates it, and
+// numThreads others take blocks of lines to call f on.
+void readPipelined(const string& fname, const LineFn& f, int numThreads) {
+  BlockQueue queue(2 * numThreads);
+  vector<thread> threads;
+  for (int i = 0; i < numThreads; i++) {
+    threads.emplace_back([&, i]() {
+      string block;
+      while (queue.pop(block)) {
+        const char* p = block.data();
+        const char* end = block.data() + block.size();
+        while (p < end) {
+          auto nl = (const char*)memchr(p, '\n', end - p);
+          const char* lineEnd = (nl == nullptr) ? end : nl;
+          f(i, boost::string_view(p, lineEnd - p));
+          p = lineEnd + 1;
+        }
+      }
+    });
+  }
+
+  string block;
+  inflateFile(fname, [&](const char* p, size_t len) {
+    block.append(p, len);
+    if (block.size() >= kChunk) {
+      size_t cut = block.rfind('\n');
+      if (cut != string::npos) {
+        string rest = block.substr(cut + 1);
+        block.resize(cut + 1);
+        queue.push(std::move(block));
+        block = std::move(rest);
+      }
+    }
+  });
+  if (!block.empty()) {
+    queue.push(std::move(block));
+  }
+  queue.close();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}
+
+bool read_gz_lines(
+    const vector<string>& files,
+    const LineFn& f,
+    int numThreads) {
+  numThreads = (std::max)(1, numThreads);
+  vector<bool> readable(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    readable[i] = ifstream(files[i]).good();
+    if (!readable[i]) {
+      cerr << "Skipping " << files[i] << ": it cannot be opened." << endl;
+    }
+  }
+  if (std::find(readable.begin(), readable.end(), true) == readable.end()) {
+    return false;
+  }
+
+  if (files.size() >= size_t(numThreads)) {
+    // Enough files to go around: file i is read by thread i % numThreads.
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+      threads.emplace_back([&, t]() {
+        for (size_t i = t; i < files.size(); i += numThreads) {
+          if (!readable[i]) {
+            continue;
+          }
+          cout << "Reading file from " << files[i] << endl;
+          LineAssembler lines(f, t);
+          inflateFile(files[i], [&](const char* p, size_t len) {
+            lines.add(p, len);
+          });
+          lines.finish();
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    return true;
+  }
+
+  // Fewer files than threads: split each file over all of them.
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!readable[i]) {
+      continue;
+    }
+    cout << "Reading file from " << files[i] << endl;
+    MappedFile file(files[i]);
+    vector<size_t> blocks;
+    if (file.good() && bgzfBlocks(file.data(), file.size(), blocks)) {
+      readBgzf(files[i], file, blocks, f, numThreads);
+    } else {
+      if (numThreads > 1) {
+        warnNotBgzf(files[i], numThreads);
+      }
+      readPipelined(files[i], f, numThreads);
+    }
+  }
+  return true;
+}
+
+#else
+
+bool read_gz_lines(
+    const vector<string>&,
+    const function<void(int, boost::string_view)>&,
+    int) {
+  cerr << "Compressed input needs a build with -D COMPRESS_FILE "
+       << "(make -f makefile_compress)." << endl;
+  return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Reading lines out of gzip compressed input on many threads.
+ *
+ * A set of files is read one file per thread. A single file is split when
+ * it can be: files written by bgzip (BGZF, as used for genomics data) are
+ * a series of independent gzip members whose headers give their size, so
+ * their members are inflated in parallel. Any other gzip file is inflated
+ * by one thread that hands blocks of whole lines to the others, so that at
+ * least the parsing is spread over all threads: its inflation itself is
+ * not parallelized.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+namespace starspace {
+
+// The compressed files given by -trainFile (or another input file name)
+// with -compressFile gzip:
+//  - "@list": the files named in list, one per line;
+//  - a pattern with *, ? or [...]: the files it matches, in sorted order;
+//  - a name ending in .gz: that file;
+//  - otherwise name00.gz, name01.gz, ... up to numGzFile files.
+std::vector<std::string> gz_input_files(
+    const std::string& name,
+    int numGzFile);
+
+// Call f(i, line) for every line of the gzip files, without its '\n', on
+// thread i < numThreads. Files that cannot be opened are skipped with a
+// warning. Returns false if none could be read.
+bool read_gz_lines(
+    const std::vector<std::string>& files,
+    const std::function<void(int, boost::string_view)>& f,
+    int numThreads = 1);
+
+}
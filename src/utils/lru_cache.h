@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * A bounded, thread-safe LRU cache. Keys are spread over a number of
+ * independently locked shards so that concurrent lookups of different
+ * keys rarely contend; each shard evicts its own least recently used entry
+ * once it holds capacity / numShards items.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace starspace {
+
+template<typename Key,
+         typename Value,
+         typename Hash = std::hash<Key>>
+class LRUCache {
+public:
+  explicit LRUCache(size_t capacity, size_t numShards = 16)
+  : hits_(0), misses_(0) {
+    numShards = (std::max)(size_t(1), (std::min)(numShards, capacity));
+    size_t perShard = (capacity + numShards - 1) / numShards;
+    for (size_t i = 0; i < numShards; i++) {
+      shards_.emplace_back(new Shard(perShard));
+    }
+  }
+
+  // Copies the cached value into v and marks it as most recently used.
+  bool get(const Key& k, Value& v) {
+    auto& shard = shardFor(k);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.index.find(k);
+    if (it == shard.index.end()) {
+      misses_++;
+      return false;
+    }
+    shard.items.splice(shard.items.begin(), shard.items, it->second);
+    v = it->second->second;
+    hits_++;
+    return true;
+  }
+
+  void put(const Key& k, const Value& v) {
+    auto& shard = shardFor(k);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.index.find(k);
+    if (it != shard.index.end()) {
+      it->second->second = v;
+      shard.items.splice(shard.items.begin(), shard.items, it->second);
+      return;
+    }
+    shard.items.emplace_front(k, v);
+    shard.index[k] = shard.items.begin();
+    if (shard.items.size() > shard.capacity) {
+      shard.index.erase(shard.items.back().first);
+      shard.items.pop_back();
+    }
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mu);
+      shard->index.clear();
+      shard->items.clear();
+    }
+  }
+
+  size_t size() const {
+    size_t retval = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mu);
+      retval += shard->items.size();
+    }
+    return retval;
+  }
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+private:
+  typedef std::list<std::pair<Key, Value>> ItemList;
+
+  struct Shard {
+    explicit Shard(size_t cap) : capacity(cap) {}
+    mutable std::mutex mu;
+    size_t capacity;
+    ItemList items;
+    std::unordered_map<Key, typename ItemList::iterator, Hash> index;
+  };
+
+  Shard& shardFor(const Key& k) {
+    // Mix the hash so that shard choice and the bucket choice inside the
+    // shard's hash table don't use the same low bits.
+    uint64_t h = uint64_t(hash_(k)) * 0x9E3779B97F4A7C15ULL;
+    return *shards_[(h >> 32) % shards_.size()];
+  }
+
+  Hash hash_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+}
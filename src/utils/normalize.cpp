@@ -12,23 +12,143 @@
 #include <assert.h>
 #include <string>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace starspace {
 
+namespace {
+
+const uint32_t kFnvOffset = 2166136261;
+const uint32_t kFnvPrime = 16777619;
+
+inline void fnv(uint32_t& h, const char* s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    h = h ^ uint32_t(s[i]);
+    h = h * kFnvPrime;
+  }
+}
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool isUpper(char c) { return c >= 'A' && c <= 'Z'; }
+inline bool isLower(char c) { return c >= 'a' && c <= 'z'; }
+
+// Lower-case s[begin, end), recording whether it holds digits, and letters
+// or non-ASCII bytes.
+inline void lowerScalar(
+    char* s, size_t begin, size_t end, bool& anyDigit, bool& anyOther) {
+  for (size_t i = begin; i < end; i++) {
+    char c = s[i];
+    assert(c); // don't shove binary data through this.
+    anyDigit |= isDigit(c);
+    if (isUpper(c)) {
+      s[i] = c + ('a' - 'A');
+      anyOther = true;
+    } else {
+      anyOther |= (c & 0x80) || isLower(c);
+    }
+  }
+}
+
+// Replace every digit of s[0, n) by '0'.
+inline void flattenDigits(char* s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (isDigit(s[i])) {
+      s[i] = '0';
+    }
+  }
+}
+
+#ifdef __SSE2__
+// Bytes of v within [lo, lo + n), as a mask. The range is shifted to the
+// bottom of the signed byte range, where SSE2 can compare it.
+inline __m128i inRange(__m128i v, char lo, char n) {
+  __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(char(0x80 - lo)));
+  return _mm_cmplt_epi8(shifted, _mm_set1_epi8(char(-128 + n)));
+}
+#endif
+
+/*
+ * We categorize longer strings into the following buckets:
+ *
+ * 1. All punctuation-and-numeric. Things in this bucket get
+ *    their numbers flattened, to prevent combinatorial explosions.
+ *    They might be specific numbers, prices, etc.
+ *
+ * 2. All letters: case-flattened.
+ *
+ * 3. Mixed letters and numbers: a product ID? Flatten case and leave
+ *    numbers alone.
+ *
+ * Only ASCII letters and digits are touched; any other byte, including
+ * every byte of a multi-byte UTF-8 character, is copied as is and makes
+ * the string non-numeric.
+ *
+ * Case is flattened while the string is classified, in the same pass,
+ * since a string that turns out to be numeric has no letters for it to
+ * change. Numbers are flattened in a second pass over numeric strings.
+ */
+
+// Normalize s[0, n) in place; if h is not null, also hash the result.
+void normalize(char* s, size_t n, uint32_t* h) {
+  bool anyDigit = false;
+  bool anyOther = false;
+  size_t i = 0;
+  if (h) {
+    *h = kFnvOffset;
+  }
+
+#ifdef __SSE2__
+  // 16 bytes at a time: classify, then add 0x20 to the upper-case letters.
+  __m128i digits = _mm_setzero_si128();
+  __m128i others = _mm_setzero_si128();
+  const __m128i caseBit = _mm_set1_epi8(0x20);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    assert(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0);
+    __m128i upper = inRange(v, 'A', 26);
+    __m128i letter = inRange(_mm_or_si128(v, caseBit), 'a', 26);
+    digits = _mm_or_si128(digits, inRange(v, '0', 10));
+    // The sign bit of a non-ASCII byte is kept by the or.
+    others = _mm_or_si128(others, _mm_or_si128(letter, v));
+    if (_mm_movemask_epi8(upper)) {
+      v = _mm_add_epi8(v, _mm_and_si128(upper, caseBit));
+      _mm_storeu_si128((__m128i*)(s + i), v);
+    }
+    if (h) {
+      fnv(*h, s + i, 16);
+    }
+  }
+  anyDigit = _mm_movemask_epi8(digits) != 0;
+  anyOther = _mm_movemask_epi8(others) != 0;
+#endif
+
+  lowerScalar(s, i, n, anyDigit, anyOther);
+  if (anyDigit && !anyOther) {
+    flattenDigits(s, n);
+    if (h) {
+      *h = kFnvOffset;
+      fnv(*h, s, n);
+    }
+  } else if (h) {
+    fnv(*h, s + i, n - i);
+  }
+}
+
+}
+
 void normalize_text(std::string& str) {
-   /*
-   * We categorize longer strings into the following buckets:
-   *
-   * 1. All punctuation-and-numeric. Things in this bucket get
-   *    their numbers flattened, to prevent combinatorial explosions.
-   *    They might be specific numbers, prices, etc.
-   *
-   * 2. All letters: case-flattened.
-   *
-   * 3. Mixed letters and numbers: a product ID? Flatten case and leave
-   *    numbers alone.
-   *
-   * The case-normalization is state-machine-driven.
-   */
+  normalize(&str[0], str.size(), nullptr);
+}
+
+uint32_t normalize_text_hash(std::string& str) {
+  uint32_t h;
+  normalize(&str[0], str.size(), &h);
+  return h;
+}
+
+void normalize_text_scalar(std::string& str) {
   bool allNumeric = true;
   bool containsDigits = false;
 
@@ -43,10 +163,7 @@ void normalize_text(std::string& str) {
     allNumeric = false;
   }
 
-  bool flattenCase = true;
   bool flattenNum = allNumeric && containsDigits;
-  if (!flattenNum && !flattenCase) return;
-
   std::transform(str.begin(), str.end(), str.begin(),
     [&](char c) {
       if (flattenNum && isdigit(c)) return '0';
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace starspace {
@@ -14,4 +15,12 @@ namespace starspace {
 // In-place normalization of UTF-8 strings.
 extern void normalize_text(std::string& buf);
 
+// Same, returning the hash of the result, equal to Dictionary::hash() of it,
+// computed in the same pass.
+extern uint32_t normalize_text_hash(std::string& buf);
+
+// The original byte-at-a-time normalize_text(), using <ctype.h>. Kept as
+// the reference the vectorized version is tested and timed against.
+extern void normalize_text_scalar(std::string& buf);
+
 }
@@ -7,10 +7,269 @@
 
 #include "utils.h"
 
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace starspace {
 
 namespace detail {
 thread_local int id;
 }
 
+namespace {
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+const uint64_t kChecksumBlock = 1 << 24;
+
+uint64_t fnv1a(const char* data, uint64_t len, uint64_t h = kFnvOffset) {
+  for (uint64_t i = 0; i < len; i++) {
+    h = (h ^ uint8_t(data[i])) * kFnvPrime;
+  }
+  return h;
+}
+}
+
+void parallel_read(
+    const std::string& fname,
+    uint64_t offset,
+    char* dest,
+    uint64_t len,
+    int numThreads) {
+  using namespace std;
+
+  numThreads = (std::max)(1, numThreads);
+  uint64_t perThread = (len + numThreads - 1) / numThreads;
+  vector<thread> threads;
+  vector<char> ok(numThreads, 1);
+  for (int i = 0; i < numThreads; i++) {
+    uint64_t start = (std::min)(len, i * perThread);
+    uint64_t end = (std::min)(len, start + perThread);
+    if (start == end) {
+      break;
+    }
+    threads.emplace_back([&fname, &ok, i, offset, dest, start, end] {
+      ifstream ifs(fname, ifstream::binary);
+      ifs.seekg(offset + start);
+      ifs.read(dest + start, end - start);
+      ok[i] = bool(ifs);
+    });
+  }
+  for (auto& t: threads) {
+    t.join();
+  }
+  for (auto b : ok) {
+    if (!b) {
+      cerr << "Model file " << fname << " cannot be read!" << endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+uint64_t block_checksum(const char* data, uint64_t len, int numThreads) {
+  using namespace std;
+
+  uint64_t numBlocks = (len + kChecksumBlock - 1) / kChecksumBlock;
+  vector<uint64_t> blockHashes(numBlocks);
+  numThreads = (std::max)(1, numThreads);
+  vector<thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.emplace_back([&, t] {
+      for (uint64_t b = t; b < numBlocks; b += numThreads) {
+        uint64_t start = b * kChecksumBlock;
+        uint64_t size = (std::min)(kChecksumBlock, len - start);
+        blockHashes[b] = fnv1a(data + start, size);
+      }
+    });
+  }
+  for (auto& t: threads) {
+    t.join();
+  }
+  // Combine the block hashes byte by byte in little-endian order, so the
+  // checksum is the same on every platform.
+  uint64_t h = kFnvOffset;
+  for (auto bh : blockHashes) {
+    for (int i = 0; i < 8; i++) {
+      h = (h ^ ((bh >> (8 * i)) & 0xff)) * kFnvPrime;
+    }
+  }
+  return h;
+}
+
+bool isLittleEndian() {
+  const uint32_t one = 1;
+  return *((const char*)&one) == 1;
+}
+
+MappedFile::MappedFile(const std::string& fname)
+  : good_(false), mapped_(false), data_(nullptr), size_(0) {
+#ifndef _WIN32
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    size_ = st.st_size;
+    good_ = true;
+    if (size_ > 0) {
+      void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        madvise(addr, size_, MADV_SEQUENTIAL);
+        data_ = (const char*)addr;
+        mapped_ = true;
+      }
+    }
+  }
+  close(fd);
+  if (mapped_ || (good_ && size_ == 0)) {
+    return;
+  }
+#endif
+  // Fall back to reading the whole file.
+  std::ifstream ifs(fname, std::ifstream::binary);
+  if (!ifs.good()) {
+    good_ = false;
+    return;
+  }
+  buffer_.assign(std::istreambuf_iterator<char>(ifs),
+                 std::istreambuf_iterator<char>());
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  good_ = true;
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (mapped_) {
+    munmap((void*)data_, size_);
+  }
+#endif
+}
+
+bool read_lines(
+    const std::string& fname,
+    const std::function<void(int, boost::string_view)>& f,
+    int numThreads) {
+  numThreads = (std::max)(1, numThreads);
+#ifndef _WIN32
+  struct stat st;
+  if (stat(fname.c_str(), &st) == 0 && !S_ISREG(st.st_mode)) {
+    // Not seekable: read blocks, carrying the partial last line of each
+    // over to the next.
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    const size_t kBlock = 1 << 20;
+    std::vector<char> buf(kBlock);
+    size_t filled = 0;
+    while (true) {
+      if (filled == buf.size()) {
+        buf.resize(buf.size() * 2);
+      }
+      ssize_t n = read(fd, buf.data() + filled, buf.size() - filled);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      const char* p = buf.data();
+      const char* end = buf.data() + filled + n;
+      const char* nl;
+      while ((nl = (const char*)memchr(p, '\n', end - p)) != nullptr) {
+        f(0, boost::string_view(p, nl - p));
+        p = nl + 1;
+      }
+      filled = end - p;
+      memmove(buf.data(), p, filled);
+    }
+    close(fd);
+    if (filled > 0) {
+      f(0, boost::string_view(buf.data(), filled));
+    }
+    return true;
+  }
+#endif
+  MappedFile file(fname);
+  if (!file.good()) {
+    return false;
+  }
+  auto partitions = line_partitions(file.data(), file.size(), numThreads);
+  auto readRange = [&](int i) {
+    const char* p = file.data() + partitions[i];
+    const char* end = file.data() + partitions[i + 1];
+    while (p < end) {
+      auto nl = (const char*)memchr(p, '\n', end - p);
+      const char* lineEnd = (nl == nullptr) ? end : nl;
+      f(i, boost::string_view(p, lineEnd - p));
+      p = lineEnd + 1;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < numThreads; i++) {
+    threads.emplace_back(readRange, i);
+  }
+  readRange(0);
+  for (auto& t : threads) {
+    t.join();
+  }
+  return true;
+}
+
+std::vector<size_t> line_partitions(
+    const char* data,
+    size_t len,
+    int numParts) {
+  numParts = (std::max)(1, numParts);
+  std::vector<size_t> retval(numParts + 1);
+  retval[0] = 0;
+  retval[numParts] = len;
+  for (int i = 1; i < numParts; i++) {
+    size_t pos = (std::max)(retval[i - 1], (len / numParts) * i);
+    // Move forward to the start of the next line.
+    if (pos > 0 && pos < len && data[pos - 1] != '\n') {
+      auto nl = (const char*)memchr(data + pos, '\n', len - pos);
+      pos = (nl == nullptr) ? len : (nl - data) + 1;
+    }
+    retval[i] = pos;
+  }
+  return retval;
+}
+
+void split_tokens(
+    boost::string_view s,
+    const std::string& sep,
+    std::vector<boost::string_view>& tokens) {
+  tokens.clear();
+  const char* p = s.data();
+  const char* end = s.data() + s.size();
+  const char* start = p;
+  for (; p < end; p++) {
+    if (memchr(sep.data(), *p, sep.size()) != nullptr) {
+      tokens.emplace_back(start, p - start);
+      start = p + 1;
+    }
+  }
+  tokens.emplace_back(start, end - start);
+}
+
+float parse_float(const char* begin, const char* end) {
+  // Numbers are short; copy into a terminated buffer for strtod.
+  char buf[64];
+  size_t n = (std::min)(size_t(end - begin), sizeof(buf) - 1);
+  memcpy(buf, begin, n);
+  buf[n] = 0;
+  return atof(buf);
+}
+
 }
@@ -12,12 +12,14 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
 #include <boost/format.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <boost/utility/string_view.hpp>
 
-#ifdef COMPRESS_FILE
-  #include <boost/iostreams/filter/gzip.hpp>
-#endif
+#include "compressed.h"
 
 namespace starspace {
 
@@ -86,114 +88,105 @@ inline int getThreadID() {
 }
 }
 
-namespace {
-template<typename Stream>
-void reset(Stream& s, std::streampos pos) {
-  s.clear();
-  s.seekg(pos, std::ios_base::beg);
-}
-
-template<typename Stream>
-std::streampos tellg(Stream& s) {
-  auto retval = s.tellg();
-  return retval;
-}
-}
-
-// Apply a closure pointwise to every line of a file.
-template<typename String=std::string,
-         typename Lambda>
-void foreach_line(const String& fname,
+// Call f(i, line) for every line of fname, without its '\n', on thread i.
+// A regular file is memory mapped and split at line boundaries into
+// numThreads ranges that are read in parallel. Anything else, such as a
+// pipe, is read sequentially in large blocks on the calling thread, as
+// thread 0. Lines point into a buffer that is only valid during the call.
+// Returns false if the file cannot be opened.
+bool read_lines(
+    const std::string& fname,
+    const std::function<void(int, boost::string_view)>& f,
+    int numThreads = 1);
+
+// Apply a closure pointwise to every line of a file, passed as a
+// boost::string_view. getThreadID() gives the reading thread.
+template<typename Lambda>
+void foreach_line(const std::string& fname,
                   Lambda f,
                   int numThreads = 1) {
-  using namespace std;
-
-  auto filelen = [&](ifstream& f) {
-    f.seekg(0, ios_base::end);
-    return tellg(f);
-  };
-
-  ifstream ifs(fname);
-  if (!ifs.good()) {
-    throw runtime_error(string("error opening ") + fname);
-  }
-  auto len = filelen(ifs);
-  // partitions[i],partitions[i+1] will be the bytewise boundaries for the i'th
-  // thread.
-  std::vector<off_t> partitions(numThreads + 1);
-  partitions[0] = 0;
-  partitions[numThreads] = len;
-
-  // Seek to bytewise partition boundaries, and read one line forward.
-  string unused;
-  for (int i = 1; i < numThreads; i++) {
-    reset(ifs, (len / numThreads) * i);
-    getline(ifs, unused);
-    partitions[i] = tellg(ifs);
-  }
-
-  // It's possible that the ranges in partitions overlap; consider,
-  // e.g., a machine with 100 hardware threads and only 99 lines
-  // in the file. In this case, we'll do some excess work, so we ask
-  // that f() be idempotent.
-  vector<thread> threads;
-  for (int i = 0; i < numThreads; i++) {
-    threads.emplace_back([i, f, &fname, &partitions] {
+  bool opened = read_lines(
+    fname,
+    [&f](int i, boost::string_view line) {
       detail::id = i;
-      // Get our own seek pointer.
-      ifstream ifs2(fname);
-      ifs2.seekg(partitions[i]);
-      string line;
-      while (tellg(ifs2) < partitions[i + 1] && getline(ifs2, line)) {
-        // We don't know the line number. Super-bummer.
-        f(line);
-      }
-    });
-  }
-  for (auto &t: threads) {
-    t.join();
+      f(line);
+    },
+    numThreads);
+  if (!opened) {
+    throw std::runtime_error(std::string("error opening ") + fname);
   }
 }
 
-template<typename String=std::string,
-         typename Lambda>
+// Read bytes [offset, offset + len) of fname into dest, splitting the range
+// over numThreads threads that each read through their own stream.
+void parallel_read(
+    const std::string& fname,
+    uint64_t offset,
+    char* dest,
+    uint64_t len,
+    int numThreads = 1);
+
+// FNV-1a checksum of a buffer. The buffer is hashed in fixed-size blocks on
+// numThreads threads and the block hashes are then hashed in order, so the
+// result does not depend on the number of threads.
+uint64_t block_checksum(const char* data, uint64_t len, int numThreads = 1);
+
+bool isLittleEndian();
+
+// Read-only view of a whole file. The file is memory mapped where the
+// platform supports it, and read into memory otherwise.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& fname);
+  ~MappedFile();
+
+  bool good() const { return good_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool good_;
+  bool mapped_;
+  const char* data_;
+  size_t size_;
+  std::vector<char> buffer_;
+};
+
+// Split [data, data + len) into numParts byte ranges that start at line
+// boundaries. Range i is [retval[i], retval[i + 1]); ranges may be empty.
+std::vector<size_t> line_partitions(const char* data, size_t len, int numParts);
+
+// Parse a float from [begin, end) with the same semantics as atof on the
+// substring, without allocating.
+float parse_float(const char* begin, const char* end);
+
+// Split s at every character found in sep, like boost::split: adjacent
+// separators delimit empty tokens. The tokens point into s, and tokens is
+// overwritten, so that reusing it across lines does not allocate.
+void split_tokens(
+    boost::string_view s,
+    const std::string& sep,
+    std::vector<boost::string_view>& tokens);
+
+// Apply a closure pointwise to every line of the gzip files given by fname
+// and numFiles (see gz_input_files), passed as a boost::string_view.
+// getThreadID() gives the reading thread.
+template<typename Lambda>
 void foreach_line_gz(
-    const String& fname,
+    const std::string& fname,
     int numFiles,
     Lambda f,
     int numThreads = 1) {
-
-  using namespace std;
-  using namespace boost::iostreams;
-
-  vector<thread> threads;
-  numThreads = std::min(numFiles, numThreads);
-
-#ifdef COMPRESS_FILE
-  for (int i = 0; i < numFiles; i++) {
-    auto thread_id = i % numThreads;
-    threads.emplace_back([thread_id, i, f, &fname] {
-      detail::id = thread_id;
-      auto fname_t = fname + boost::str(boost::format("%02d") % i) + ".gz";
-      ifstream ifs2(fname_t);
-      if (!ifs2.good()) {
-        return;
-      }
-
-      cout << "Reading file from " << fname_t << endl;
-      filtering_istream in;
-      in.push(gzip_decompressor());
-      in.push(ifs2);
-      std::string line;
-      while (getline(in, line, '\n')) {
-        f(line);
-      }
-    });
-  }
-  for (auto &t: threads) {
-    t.join();
-  }
-#endif
+  read_gz_lines(
+    gz_input_files(fname, numFiles),
+    [&f](int i, boost::string_view line) {
+      detail::id = i;
+      f(line);
+    },
+    numThreads);
 }
 
 } // namespace